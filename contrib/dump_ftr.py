@@ -5,74 +5,167 @@ import os
 import sys
 from optparse import OptionParser
 import logging
-from cbor2 import load, loads
+from cbor2 import load, loads, CBORTag
 import lz4.block
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
 
 logger = logging.getLogger(__name__)
 
+# chunk types, see ftr_writer.h
+INFO, DICT, DIR, TX, REL, COMP_DICT, DICT_TX, INDEX, FOOTER, DELTA_TX, DICT_DELTA_TX, COLUMNAR_TX, DICT_COLUMNAR_TX = range(13)
+# chunks not part of the original format use tags starting at this one
+EXT_CHUNK_TAG_BASE = 0x46545200
+ZSTD_TAG_OFFSET = 32
+
+def chunk_type(tag):
+    """returns chunk type, compressed and zstd flag of a chunk tag"""
+    if 6 <= tag <= 15:
+        return (tag - 6) // 2, tag % 2 == 1, False
+    n = tag - EXT_CHUNK_TAG_BASE
+    if not 0 <= n < 2 * ZSTD_TAG_OFFSET:
+        return None, False, False
+    zstd = n >= ZSTD_TAG_OFFSET
+    if zstd:
+        n -= ZSTD_TAG_OFFSET
+    return n // 2, n % 2 == 1, zstd
+
+def tag_hook(f):
+    """adapts f(tag) to cbor2's tag hook, called with (decoder, tag) before version 6 and with (tag, immutable) since"""
+    return lambda a, b: f(b if isinstance(b, CBORTag) else a)
+
+def decompress(data, size, zstd, dictionary=None):
+    if dictionary is not None:
+        return lz4.block.decompress(data, uncompressed_size=size, dict=dictionary)
+    if not zstd:
+        return lz4.block.decompress(data, uncompressed_size=size)
+    if zstandard is None:
+        raise RuntimeError("found a zstd compressed chunk but the zstandard module is not installed")
+    return zstandard.ZstdDecompressor().decompress(data, max_output_size=size)
+
+def unshuffle(data, width):
+    """returns the little endian numbers of a column stored byte plane wise"""
+    count = len(data) // width
+    return [int.from_bytes(bytes(data[plane * count + i] for plane in range(width)), 'little') for i in range(count)]
+
+def unpack_vector(width, data, bits):
+    """returns a packed bit (1 bit per position) or logic vector (2 bits) as string, most significant position first"""
+    value = int.from_bytes(data, 'little')
+    return ''.join("01ZX"[(value >> (bits * i)) & ((1 << bits) - 1)] for i in reversed(range(width)))
+
 def dump_ftr(file_name_input):
     strings = {}
+    footer = []
+    # compression dictionaries by id
+    dictionaries = {}
 
-    def tag_cb(decoder, tag):
-        def tx_tag_cb(decoder, txtag):
-            if txtag.tag == 6:
-                # id, generator id, start time, end time
-                print(f"trans id:{txtag.value[0]}, gen:{txtag.value[1]}, start:{txtag.value[2]}, end:{txtag.value[3]}")
-            elif txtag.tag == 7: # begin attr
-                attr_name = strings[txtag.value[0]]
-                if txtag.value[1] in [10, 1]:
-                    print(f"  battr {attr_name}, type_id:{txtag.value[1]}, value:{strings[txtag.value[2]]}")
-                else:
-                    print(f"  battr {attr_name}, type_id:{txtag.value[1]}, value:{txtag.value[2]}")
-            elif txtag.tag == 8: # record attr
-                attr_name = strings[txtag.value[0]]
-                if txtag.value[1] in [10, 1]:
-                    print(f"  rattr {attr_name}, type_id:{txtag.value[1]}, value:{strings[txtag.value[2]]}")
-                else:
-                    print(f"  rattr {attr_name}, type_id:{txtag.value[1]}, value:{txtag.value[2]}")
-            elif txtag.tag == 9: # end attr
-                attr_name = strings[txtag.value[0]]
-                if txtag.value[1] in [10, 1]:
-                    print(f"  eattr {attr_name}, type_id:{txtag.value[1]}, value:{strings[txtag.value[2]]}")
-                else:
-                    print(f"  eattr {attr_name}, type_id:{txtag.value[1]}, value:{txtag.value[2]}")
+    def attr_value(type_id, value):
+        if type_id in [10, 1]:
+            # strings of attributes having many distinct values are stored inline
+            return strings[value] if isinstance(value, int) else value
+        if type_id in [5, 6]:
+            # PLAIN tx blocks and earlier versions store vectors as strings
+            return strings[value] if isinstance(value, int) else unpack_vector(value[0], value[1], type_id - 4)
+        return value
+
+    def print_tx(id, gen, start, end, attributes):
+        print(f"trans id:{id}, gen:{gen}, start:{start}, end:{end}")
+        for attr_tag, name, type_id, value in attributes:
+            kind = {7: "battr", 8: "rattr", 9: "eattr"}.get(attr_tag)
+            if kind is None:
+                print(f"Found unknown entry: {attr_tag}")
             else:
-                print(f"Found unknown entry: {txtag.tag}")
-            return None
-    
-        if tag.tag == 6:
+                print(f"  {kind} {strings[name]}, type_id:{type_id}, value:{attr_value(type_id, value)}")
+
+    def print_tx_block(content, delta):
+        # ids and time stamps of delta encoded blocks are differences to the preceding transaction
+        prev_id, prev_gen, prev_start = 0, 0, 0
+        for tx in loads(content):
+            id, gen, start, end = tx[0].value
+            if delta:
+                id, gen, start = prev_id + id, prev_gen + gen, prev_start + start
+                end += start
+                prev_id, prev_gen, prev_start = id, gen, start
+            print_tx(id, gen, start, end, [(attr.tag, *attr.value) for attr in tx[1:]])
+
+    def print_columnar_tx_block(content):
+        ids, gens, starts, ends, columns = loads(content)
+        ids, gens, starts, ends = (unshuffle(column, 8) for column in (ids, gens, starts, ends))
+        attributes = [[] for _ in ids]
+        for attr_tag, name, type_id, rows, values in columns:
+            for row, value in zip(unshuffle(rows, 4), values):
+                attributes[row].append((attr_tag, name, type_id, value))
+        # the differences are stored as unsigned 64 bit numbers
+        mask = (1 << 64) - 1
+        id, start = 0, 0
+        for row in range(len(ids)):
+            id, start = (id + ids[row]) & mask, (start + starts[row]) & mask
+            print_tx(id, gens[row], start, (start + ends[row]) & mask, attributes[row])
+
+    def dir_cb(tag):
+        if tag.tag == 16:
+            print(f"stream id:{tag.value[0]}, name:{strings[tag.value[1]]}, kind;:{strings[tag.value[2]]}")
+        elif tag.tag == 17:
+            print(f"generator id:{tag.value[0]}, name:{strings[tag.value[1]]}, stream:{tag.value[2]}")
+        else:
+            print(f"Found unknown entry: {tag.tag}")
+        return None
+
+    def tag_cb(tag):
+        type, compressed, zstd = chunk_type(tag.tag)
+        if type == INFO:
             logger.debug("Found info chunk")
-        elif tag.tag in [8, 9]:
-            strings.update(loads(tag.value if tag.tag==8 else lz4.block.decompress(tag.value[1], uncompressed_size=tag.value[0])))
+        elif type == DICT:
+            strings.update(loads(decompress(tag.value[1], tag.value[0], zstd) if compressed else tag.value))
             logger.debug("Found dictionary chunk")
-        elif tag.tag in [10, 11]:
-            direct = loads(tag.value if tag.tag==10 else lz4.block.decompress(tag.value[1], uncompressed_size=tag.value[0]), tag_hook=tag_cb)
+        elif type == DIR:
+            loads(decompress(tag.value[1], tag.value[0], zstd) if compressed else tag.value, tag_hook=tag_hook(dir_cb))
             logger.debug("Found directory chunk")
-        elif tag.tag in [12, 13]:
-            tx_stream_id = tag.value[0]
-            txchunk = loads(tag.value[3] if tag.tag==12 else lz4.block.decompress(tag.value[4], uncompressed_size=tag.value[3]), tag_hook=tx_tag_cb)
+        elif type in [TX, DELTA_TX]:
+            print_tx_block(decompress(tag.value[4], tag.value[3], zstd) if compressed else tag.value[3], type == DELTA_TX)
             logger.debug(f"Found tx chunk of stream id {tag.value[0]}")
-        elif tag.tag in [14, 15]:
-            relations = loads(tag.value if tag.tag==14 else lz4.block.decompress(tag.value[1], uncompressed_size=tag.value[0]))
+        elif type == COLUMNAR_TX:
+            print_columnar_tx_block(decompress(tag.value[4], tag.value[3], zstd) if compressed else tag.value[3])
+            logger.debug(f"Found columnar tx chunk of stream id {tag.value[0]}")
+        elif type == COMP_DICT:
+            dictionaries[tag.value[0]] = decompress(tag.value[2], tag.value[1], zstd)
+            logger.debug(f"Found compression dictionary {tag.value[0]}")
+        elif type in [DICT_TX, DICT_DELTA_TX, DICT_COLUMNAR_TX]:
+            content = decompress(tag.value[5], tag.value[4], zstd, dictionaries[tag.value[3]])
+            if type == DICT_COLUMNAR_TX:
+                print_columnar_tx_block(content)
+            else:
+                print_tx_block(content, type == DICT_DELTA_TX)
+            logger.debug(f"Found tx chunk of stream id {tag.value[0]} compressed using dictionary {tag.value[3]}")
+        elif type == REL:
+            relations = loads(decompress(tag.value[1], tag.value[0], zstd) if compressed else tag.value)
             logger.debug("Found relationship chunk")
-        elif tag.tag == 16:
-            print(f"stream id:{tag.value[0]}, name:{strings[tag.value[1]]}, kind;:{strings[tag.value[2]]}")
-        elif tag.tag == 17:
-            print(f"generator id:{tag.value[0]}, name:{strings[tag.value[1]]}, stream:{tag.value[2]}")
+        elif type == INDEX:
+            chunks, blocks = loads(tag.value)
+            logger.debug(f"Found index chunk listing {len(chunks)} chunks and {len(blocks)} tx blocks")
+        elif type == FOOTER:
+            footer.append(tag.value)
+            logger.debug(f"Found footer chunk, index at offset {tag.value}")
         else:
             print(f"Found unknown entry: {tag.tag}")
         return None
-    
+
     with open(file_name_input, 'rb') as fp:
-        obj = load(fp, tag_hook=tag_cb)
-        
-        
-if __name__== "__main__":    
+        obj = load(fp, tag_hook=tag_hook(tag_cb))
+        # the footer points to the index chunk which starts with its 4 byte tag
+        if footer:
+            fp.seek(footer[0])
+            if fp.read(5) != bytes([0xda]) + (EXT_CHUNK_TAG_BASE + 2 * INDEX).to_bytes(4, 'big'):
+                logger.error(f"footer of {file_name_input} does not point to the index chunk")
+
+
+if __name__== "__main__":
     parser = OptionParser()
-    parser.add_option("-v", "--verbose", action="store_true", dest="verbose", 
+    parser.add_option("-v", "--verbose", action="store_true", dest="verbose",
                       help="set output verbosity", default=False, metavar="")
     (options, args)  = parser.parse_args()
     logging.basicConfig(format='%(levelname)s: %(message)s', level=logging.DEBUG if options.verbose  else logging.INFO)
     for arg in args:
         dump_ftr(arg)
-    
\ No newline at end of file
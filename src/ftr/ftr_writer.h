@@ -17,79 +17,414 @@
 #ifndef FTR_FTR_WRITER_H
 #define FTR_FTR_WRITER_H
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
 #include <deque>
-#include <fstream>
 #include <limits>
 #include <lz4.h>
+#include <lz4hc.h>
 #include <memory>
+#include <mutex>
 #include <nonstd/string_view.hpp>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
 
 namespace ftr {
 enum {
     MAX_TXBUFFER_SIZE = 1 << 16,
     MAX_REL_SIZE = 1 << 16,
+    DEFAULT_FILE_BUFFER_SIZE = 1 << 20,
+    DEFAULT_QUEUE_DEPTH = 16,
     INFO_CHUNK_ID = 0,
     DICT_CHUNK_ID = 1,
     DIR_CHUNK_ID = 2,
     TX_CHUNK_ID = 3,
-    REL_CHUNK_ID = 4
+    REL_CHUNK_ID = 4,
+    COMP_DICT_CHUNK_ID = 5,
+    DICT_TX_CHUNK_ID = 6,
+    INDEX_CHUNK_ID = 7,
+    FOOTER_CHUNK_ID = 8,
+    DELTA_TX_CHUNK_ID = 9,
+    DICT_DELTA_TX_CHUNK_ID = 10,
+    COLUMNAR_TX_CHUNK_ID = 11,
+    DICT_COLUMNAR_TX_CHUNK_ID = 12,
+    ZSTD_TAG_OFFSET = 32,
+    // first tag of the block used by chunks not part of the original format ("FTR\0")
+    EXT_CHUNK_TAG_BASE = 0x46545200,
+    MAX_LZ4_DICT_SIZE = 1 << 16
+};
+/**
+ * CBOR tag of a chunk. The chunk types of the original format keep the tags 6 to 15. All other chunk types and zstd
+ * compressed chunks use a block of unassigned tags as most small tag numbers are registered and resolved by generic
+ * CBOR decoders (e.g. 25 and 29 as string and shared references).
+ */
+inline uint64_t chunk_tag(uint64_t type, bool compressed, bool zstd = false) {
+    if(type <= REL_CHUNK_ID && !zstd)
+        return 6 + 2 * type + (compressed ? 1 : 0);
+    return EXT_CHUNK_TAG_BASE + 2 * type + (compressed ? 1 : 0) + (zstd ? ZSTD_TAG_OFFSET : 0);
+}
+
+inline bool is_tx_chunk(uint64_t type) {
+    switch(type) {
+    case TX_CHUNK_ID:
+    case DICT_TX_CHUNK_ID:
+    case DELTA_TX_CHUNK_ID:
+    case DICT_DELTA_TX_CHUNK_ID:
+    case COLUMNAR_TX_CHUNK_ID:
+    case DICT_COLUMNAR_TX_CHUNK_ID:
+        return true;
+    default:
+        return false;
+    }
+}
+// chunk type of a tx block compressed using a compression dictionary
+inline uint64_t dict_chunk_type(uint64_t type) {
+    return type == TX_CHUNK_ID ? DICT_TX_CHUNK_ID : type == DELTA_TX_CHUNK_ID ? DICT_DELTA_TX_CHUNK_ID : DICT_COLUMNAR_TX_CHUNK_ID;
+}
+
+/// compression algorithms, LZ4 and LZ4_HC create the same block format and differ only in speed and ratio
+enum class codec { LZ4, LZ4_HC, ZSTD };
+
+struct compression {
+    codec algorithm{codec::LZ4};
+    /// acceleration factor of LZ4, compression level of LZ4_HC and ZSTD, 0 selects the default of the codec
+    int level{0};
+    /// size of the per stream compression dictionaries of the LZ4 codecs (at most 64KiB), 0 disables them
+    size_t dictionary_size{0};
+};
+
+/// encoding of the transaction headers in a tx block
+enum class block_format {
+    /// absolute ids and time stamps (chunk type 3) and the value encodings of the original format: strings are always
+    /// dictionary keys and bit and logic vectors are written as strings, so older readers can read the file
+    PLAIN,
+    /// id, generator and start time relative to the previous transaction of the block, end relative to start (chunk type 9)
+    DELTA,
+    /// like DELTA but each header field and each attribute is stored as a separate column (chunk type 11)
+    COLUMNAR
+};
+
+/// format and limits of the tx data buffered per stream before it is written
+struct block_policy {
+    block_format format{block_format::DELTA};
+    /// size in bytes at which the tx block of a stream is written once its last transaction is complete, so it caps the
+    /// data buffered per stream
+    size_t block_size{MAX_TXBUFFER_SIZE};
+    /// limit of the bytes buffered in all tx blocks, if exceeded the oldest blocks are written first. 0 disables it
+    size_t memory_budget{0};
+    /// time after which a tx block is written regardless of its size (in the time unit of the time stamps). 0 disables it
+    uint64_t max_age{0};
+    /// number of strings the values of an attribute name may add to the dictionary, further new values are written
+    /// inline. 0 disables the limit, PLAIN blocks always use the dictionary
+    size_t max_distinct_strings{4096};
+};
+
+/// LZ4 compression dictionary of a stream, it is the tail of the first tx block of the stream
+struct compression_dict {
+    uint64_t const id;
+    std::vector<uint8_t> content;
+    compression_dict(uint64_t id, uint8_t const* data, size_t size, size_t max_size)
+    : id(id) {
+        auto used = std::min(size, std::min<size_t>(max_size, MAX_LZ4_DICT_SIZE));
+        content.assign(data + size - used, data + size);
+    }
+};
+
+/**
+ * growable byte array used to assemble chunks. Unlike std::vector appended space is not initialized so the encoder
+ * can reserve the worst case of an item and give back what it did not use.
+ */
+class byte_buffer {
+public:
+    byte_buffer() = default;
+    byte_buffer(byte_buffer const&) = delete;
+    byte_buffer(byte_buffer&& o) noexcept { swap(o); }
+    byte_buffer& operator=(byte_buffer const&) = delete;
+    byte_buffer& operator=(byte_buffer&& o) noexcept {
+        swap(o);
+        return *this;
+    }
+    uint8_t* data() { return mem.get(); }
+    uint8_t const* data() const { return mem.get(); }
+    size_t size() const { return len; }
+    size_t capacity() const { return cap; }
+    bool empty() const { return len == 0; }
+    void clear() { len = 0; }
+    void swap(byte_buffer& o) noexcept {
+        std::swap(mem, o.mem);
+        std::swap(len, o.len);
+        std::swap(cap, o.cap);
+    }
+    /// appends size bytes with undefined content and returns a pointer to them
+    uint8_t* grow(size_t size) {
+        if(cap - len < size)
+            reallocate(len + size);
+        auto* ret = mem.get() + len;
+        len += size;
+        return ret;
+    }
+    /// removes size bytes from the end
+    void shrink(size_t size) { len -= size; }
+    void append(uint8_t const* values, size_t size) {
+        if(size)
+            std::memcpy(grow(size), values, size);
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> mem;
+    size_t len{0}, cap{0};
+    void reallocate(size_t min_size) {
+        auto new_cap = std::max<size_t>(std::max<size_t>(2 * cap, min_size), 256);
+        std::unique_ptr<uint8_t[]> new_mem(new uint8_t[new_cap]);
+        if(len)
+            std::memcpy(new_mem.get(), mem.get(), len);
+        mem = std::move(new_mem);
+        cap = new_cap;
+    }
 };
 
 struct memory_writer {
-    std::vector<uint8_t> buffer;
-    void push(uint8_t value) { buffer.push_back(value); }
+    byte_buffer buffer;
+    void push(uint8_t value) { *buffer.grow(1) = value; }
     void push(char value) { push(static_cast<uint8_t>(value)); }
-    void push(uint8_t const* values, size_t size) { buffer.insert(std::end(buffer), values, values + size); }
+    void push(uint8_t const* values, size_t size) { buffer.append(values, size); }
     void push(char const* values, size_t size) { push(reinterpret_cast<uint8_t const*>(values), size); }
+    uint8_t* alloc(size_t size) { return buffer.grow(size); }
+    void trim(size_t size) { buffer.shrink(size); }
     bool is_empty() { return buffer.empty(); }
     void clear() { buffer.clear(); }
-    void append(memory_writer& o) { buffer.insert(buffer.end(), o.buffer.begin(), o.buffer.end()); }
+    void append(memory_writer& o) { buffer.append(o.buffer.data(), o.buffer.size()); }
 };
 
+/**
+ * file output staging everything in a page aligned buffer which is handed to the kernel once it is full. Data not
+ * fitting into the remaining space is written together with the staged data by a single writev() call so large
+ * chunk payloads are not copied. Windows lacks writev() so there both are written by unbuffered fwrite() calls.
+ */
 struct file_writer {
-    std::ofstream ofs;
-    std::vector<uint8_t> buffer;
-    void push(uint8_t value) { push(static_cast<char>(value)); }
-    void push(char value) { ofs.write(&value, 1); }
-    void push(uint8_t const* values, size_t size) { push(reinterpret_cast<char const*>(values), size); }
-    void push(char const* values, size_t size) { ofs.write(values, size); }
+    file_writer() = default;
+    file_writer(file_writer const&) = delete;
+    file_writer& operator=(file_writer const&) = delete;
+    ~file_writer() { close(); }
+
+    bool open(std::string const& name, size_t buffer_size = DEFAULT_FILE_BUFFER_SIZE) {
+        close();
+#ifdef _WIN32
+        file = std::fopen(name.c_str(), "wb");
+        if(!file)
+            return false;
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        size_t const page_size = 4096;
+#else
+        fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+            return false;
+        auto const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        written = 0;
+        err = 0;
+        capacity = std::max<size_t>(1, (buffer_size + page_size - 1) / page_size) * page_size;
+        storage.reset(new uint8_t[capacity + page_size]);
+        void* aligned = storage.get();
+        auto space = capacity + page_size;
+        buffer = static_cast<uint8_t*>(std::align(page_size, capacity, aligned, space));
+        fill = 0;
+        return true;
+    }
+
+    bool is_open() const {
+#ifdef _WIN32
+        return file != nullptr;
+#else
+        return fd >= 0;
+#endif
+    }
+    /// errno of the first failed write or 0, the data of all later writes is discarded
+    int error() const { return err; }
+    /// fails the output like a failed write, e.g. if data could not be encoded
+    void fail(int error) {
+        if(!err)
+            err = error;
+    }
+    /// offset in the file of the next byte pushed
+    uint64_t position() const { return written + fill; }
+
+    void close() {
+        if(!is_open())
+            return;
+        flush();
+#ifdef _WIN32
+        std::fclose(file);
+        file = nullptr;
+#else
+        ::close(fd);
+        fd = -1;
+#endif
+    }
+
+    void flush() { write_out(nullptr, 0); }
+
+    void push(uint8_t value) {
+        if(fill == capacity)
+            flush();
+        buffer[fill++] = value;
+    }
+    void push(char value) { push(static_cast<uint8_t>(value)); }
+    void push(uint8_t const* values, size_t size) {
+        if(size <= capacity - fill) {
+            std::memcpy(buffer + fill, values, size);
+            fill += size;
+        } else
+            write_out(values, size);
+    }
+    void push(char const* values, size_t size) { push(reinterpret_cast<uint8_t const*>(values), size); }
+    // reserves size bytes (at most one page) in the staging buffer
+    uint8_t* alloc(size_t size) {
+        if(capacity - fill < size)
+            flush();
+        auto* ret = buffer + fill;
+        fill += size;
+        return ret;
+    }
+    void trim(size_t size) { fill -= size; }
     bool is_empty() { return false; }
     void clear() {}
+
+private:
+#ifdef _WIN32
+    std::FILE* file{nullptr};
+#else
+    int fd{-1};
+#endif
+    std::unique_ptr<uint8_t[]> storage;
+    uint8_t* buffer{nullptr};
+    size_t capacity{0}, fill{0};
+    uint64_t written{0};
+    int err{0};
+#ifdef _WIN32
+    // writes the staged data followed by size bytes of data
+    void write_out(uint8_t const* data, size_t size) {
+        written += fill + size;
+        write_file(buffer, fill);
+        write_file(data, size);
+        fill = 0;
+    }
+
+    void write_file(uint8_t const* data, size_t size) {
+        errno = 0;
+        if(size && !err && std::fwrite(data, 1, size, file) != size)
+            err = errno ? errno : EIO;
+    }
+#else
+    // writes the staged data followed by size bytes of data, partial writes are continued
+    void write_out(uint8_t const* data, size_t size) {
+        written += fill + size;
+        iovec iov[2] = {{buffer, fill}, {const_cast<uint8_t*>(data), size}};
+        iovec* cur = iov;
+        int count = size ? 2 : 1;
+        while(count && !cur->iov_len) {
+            ++cur;
+            --count;
+        }
+        while(count && !err) {
+            auto written = ::writev(fd, cur, count);
+            if(written < 0) {
+                if(errno != EINTR)
+                    err = errno;
+                continue;
+            }
+            for(; count && static_cast<size_t>(written) >= cur->iov_len; ++cur, --count)
+                written -= cur->iov_len;
+            if(count) {
+                cur->iov_base = static_cast<uint8_t*>(cur->iov_base) + written;
+                cur->iov_len -= written;
+            }
+        }
+        fill = 0;
+    }
+#endif
+};
+
+inline uint32_t to_big_endian(uint32_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return value;
+#elif defined(_MSC_VER)
+    return _byteswap_ulong(value);
+#else
+    return __builtin_bswap32(value);
+#endif
+}
+
+inline uint64_t to_big_endian(uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return value;
+#elif defined(_MSC_VER)
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+}
+
+/// bit or logic vector packed with 1 or 2 bits per position, position 0 is stored in the least significant bits
+struct packed_vector {
+    uint64_t length; // number of positions
+    uint8_t const* data;
+    size_t size;
 };
+/// stores the positions of a packed vector as '0', '1', 'Z' and 'X' in text, the most significant position first
+inline void to_text(packed_vector const& value, unsigned bits, std::string& text) {
+    text.resize(value.length);
+    for(uint64_t i = 0; i < value.length; ++i) {
+        auto const bit = i * bits;
+        text[value.length - 1 - i] = "01ZX"[(value.data[bit / 8] >> (bit % 8)) & ((1U << bits) - 1)];
+    }
+}
 
+/**
+ * CBOR encoder on top of an output providing push(), alloc() and trim(). Heads are written by reserving the worst case
+ * of 9 bytes once, storing the argument with a single big endian store and trimming the unused bytes afterwards.
+ */
 template <typename OUTPUT> struct encoder : public OUTPUT {
     void write(bool value) { this->push(static_cast<uint8_t>(value ? 0xf5 : 0xf4)); } // 7::21, 7::20
     template <typename T> typename std::enable_if<std::is_signed<T>::value, void>::type write(T value) {
         if(value < 0)
-            write_type_value(1, std::abs(value) - 1);
+            write_type_value(1, static_cast<uint64_t>(~static_cast<int64_t>(value))); // -1 - value
         else
             write_type_value(0, value);
     }
     template <typename T> typename std::enable_if<std::is_unsigned<T>::value, void>::type write(T value) { write_type_value(0, value); }
     void write(float value) {
-        auto* punny = reinterpret_cast<uint8_t*>(&value);
-        this->push(static_cast<uint8_t>((7 << 5) | 26));
-        this->push(*(punny + 3));
-        this->push(*(punny + 2));
-        this->push(*(punny + 1));
-        this->push(*(punny + 0));
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits = to_big_endian(bits);
+        auto* out = this->alloc(1 + sizeof(bits));
+        out[0] = static_cast<uint8_t>((7 << 5) | 26);
+        std::memcpy(out + 1, &bits, sizeof(bits));
     }
     void write(double value) {
-        auto* punny = reinterpret_cast<uint8_t*>(&value);
-        this->push(static_cast<uint8_t>((7 << 5) | 27));
-        this->push(*(punny + 7));
-        this->push(*(punny + 6));
-        this->push(*(punny + 5));
-        this->push(*(punny + 4));
-        this->push(*(punny + 3));
-        this->push(*(punny + 2));
-        this->push(*(punny + 1));
-        this->push(*(punny + 0));
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits = to_big_endian(bits);
+        auto* out = this->alloc(1 + sizeof(bits));
+        out[0] = static_cast<uint8_t>((7 << 5) | 27);
+        std::memcpy(out + 1, &bits, sizeof(bits));
     }
     template <typename T> typename std::enable_if<std::is_unsigned<T>::value, void>::type write(T const* data, size_t size) {
         write_type_value(2, size);
@@ -99,9 +434,17 @@ template <typename OUTPUT> struct encoder : public OUTPUT {
         write_type_value(3, size);
         this->push(data, size);
     }
-    void write(const std::string str) {
-        write_type_value(3, str.size());
-        this->push(str.c_str(), str.size());
+    // array(2) of the number of positions and the packed positions as byte string
+    void write(packed_vector const& value) {
+        start_array(2);
+        write(value.length);
+        write(value.data, value.size);
+    }
+    void write(const std::string str) { write_text(str.data(), str.size()); }
+    void write(nonstd::string_view const& str) { write_text(str.data(), str.size()); }
+    void write_text(char const* str, size_t size) {
+        write_type_value(3, size);
+        this->push(str, size);
     }
     void start_array(size_t size = std::numeric_limits<size_t>::max()) {
         if(size < std::numeric_limits<size_t>::max())
@@ -122,73 +465,327 @@ template <typename OUTPUT> struct encoder : public OUTPUT {
     void write_undefined() { this->push(0xf7); } // 7::23
 private:
     void write_type_value(int major_type, uint64_t value) {
-        major_type <<= 5;
-        if(value < 24) {
-            this->push(static_cast<uint8_t>(major_type | value));
-        } else if(value < std::numeric_limits<uint8_t>::max()) {
-            this->push(static_cast<uint8_t>(major_type | 24));
-            this->push(static_cast<uint8_t>(value));
-        } else if(value < std::numeric_limits<uint16_t>::max()) {
-            this->push(static_cast<uint8_t>(major_type | 25));
-            this->push(static_cast<uint8_t>(value >> 8));
-            this->push(static_cast<uint8_t>(value));
-        } else if(value < std::numeric_limits<uint32_t>::max()) {
-            this->push(static_cast<uint8_t>(major_type | 26));
-            this->push(static_cast<uint8_t>(value >> 24));
-            this->push(static_cast<uint8_t>(value >> 16));
-            this->push(static_cast<uint8_t>(value >> 8));
-            this->push(static_cast<uint8_t>(value));
+        // size class 0 (immediate value) to 4 (8 byte argument) selected without branches
+        unsigned const cls = (value > 23) + (value > 0xff) + (value > 0xffff) + (value > 0xffffffff);
+        static constexpr uint8_t arg_size[] = {0, 1, 2, 4, 8};
+        static constexpr uint8_t arg_shift[] = {0, 56, 48, 32, 0};
+        auto* out = this->alloc(9);
+        out[0] = static_cast<uint8_t>((major_type << 5) | (cls ? 23 + cls : value));
+        auto const arg = to_big_endian(value << arg_shift[cls]);
+        std::memcpy(out + 1, &arg, sizeof(arg));
+        this->trim(8 - arg_size[cls]);
+    }
+};
+
+/**
+ * compression state of a thread. The codec states are created on first use and reused for all further chunks, the
+ * destination is a caller provided buffer which keeps its capacity.
+ */
+class compressor {
+public:
+    compressor() = default;
+    compressor(compressor const&) = delete;
+    compressor& operator=(compressor const&) = delete;
+    ~compressor() {
+        if(lz4)
+            LZ4_freeStream(lz4);
+        if(lz4hc)
+            LZ4_freeStreamHC(lz4hc);
+#ifdef WITH_ZSTD
+        ZSTD_freeCCtx(zstd);
+#endif
+    }
+
+    /// returns false and leaves dst empty if the codec failed
+    bool compress(compression const& comp, compression_dict const* dict, byte_buffer const& src, byte_buffer& dst) {
+        dst.clear();
+#ifdef WITH_ZSTD
+        if(comp.algorithm == codec::ZSTD) {
+            if(!zstd && !(zstd = ZSTD_createCCtx()))
+                return false;
+            auto bound = ZSTD_compressBound(src.size());
+            auto size = ZSTD_compressCCtx(zstd, dst.grow(bound), bound, src.data(), src.size(), comp.level);
+            if(ZSTD_isError(size)) {
+                dst.clear();
+                return false;
+            }
+            dst.shrink(bound - size);
+            return true;
+        }
+#endif
+        auto bound = static_cast<size_t>(LZ4_compressBound(src.size()));
+        auto in = reinterpret_cast<char const*>(src.data());
+        auto out = reinterpret_cast<char*>(dst.grow(bound));
+        int size;
+        if(comp.algorithm == codec::LZ4_HC) {
+            if(!lz4hc && !(lz4hc = LZ4_createStreamHC()))
+                return false;
+            if(dict) {
+                LZ4_resetStreamHC_fast(lz4hc, comp.level);
+                LZ4_loadDictHC(lz4hc, reinterpret_cast<char const*>(dict->content.data()), dict->content.size());
+                size = LZ4_compress_HC_continue(lz4hc, in, out, src.size(), bound);
+            } else
+                size = LZ4_compress_HC_extStateHC(lz4hc, in, out, src.size(), bound, comp.level);
         } else {
-            this->push(static_cast<uint8_t>(major_type | 27));
-            this->push(static_cast<uint8_t>(value >> 56));
-            this->push(static_cast<uint8_t>(value >> 48));
-            this->push(static_cast<uint8_t>(value >> 40));
-            this->push(static_cast<uint8_t>(value >> 32));
-            this->push(static_cast<uint8_t>(value >> 24));
-            this->push(static_cast<uint8_t>(value >> 16));
-            this->push(static_cast<uint8_t>(value >> 8));
-            this->push(static_cast<uint8_t>(value));
+            if(!lz4 && !(lz4 = LZ4_createStream()))
+                return false;
+            if(dict) {
+                LZ4_loadDict(lz4, reinterpret_cast<char const*>(dict->content.data()), dict->content.size());
+                size = LZ4_compress_fast_continue(lz4, in, out, src.size(), bound, comp.level);
+            } else
+                size = LZ4_compress_fast_extState(lz4, in, out, src.size(), bound, comp.level);
+        }
+        if(size <= 0) {
+            dst.clear();
+            return false;
         }
+        dst.shrink(bound - size);
+        return true;
     }
+
+private:
+    LZ4_stream_t* lz4{nullptr};
+    LZ4_streamHC_t* lz4hc{nullptr};
+#ifdef WITH_ZSTD
+    ZSTD_CCtx* zstd{nullptr};
+#endif
 };
 
+/**
+ * writes the chunks to the file. With a queue depth larger than 0 the buffers are handed over to a pool of worker
+ * threads through a bounded queue, the caller gets an empty buffer back and can keep encoding. The workers compress
+ * queued chunks concurrently while whichever worker completes the oldest chunk writes all completed chunks in
+ * submission order. So the output is deterministic and dictionary chunks still precede their users.
+ */
 template <bool COMPRESSED = false> struct chunk_writer {
     encoder<file_writer> enc;
-    chunk_writer(std::string const& filename) {
-        enc.ofs.open(filename, std::ios::binary | std::ios::out);
-        if(enc.ofs.is_open()) {
+    chunk_writer(std::string const& filename, size_t buffer_size = DEFAULT_FILE_BUFFER_SIZE, unsigned queue_depth = 0,
+                 unsigned threads = 1, compression comp = {})
+    : queue_depth(std::max(queue_depth, threads))
+    , comp(comp) {
+#ifndef WITH_ZSTD
+        if(this->comp.algorithm == codec::ZSTD) {
+            this->comp.algorithm = codec::LZ4;
+            this->comp.level = 0;
+        }
+#endif
+        // zstd compresses each block better without a raw content dictionary
+        if(this->comp.algorithm == codec::ZSTD)
+            this->comp.dictionary_size = 0;
+        if(enc.open(filename, buffer_size)) {
             enc.write_tag(55799); // Self-Described CBOR
             enc.start_array();
+            // without compression there is nothing to parallelize
+            if(queue_depth)
+                for(auto i = COMPRESSED ? std::max(threads, 1U) : 1U; i > 0; --i)
+                    workers.emplace_back(&chunk_writer::run, this);
         }
     }
 
-    ~chunk_writer() {
-        if(enc.ofs.is_open()) {
+    ~chunk_writer() { close(); }
+    /// writes the queued chunks, the index and the footer and closes the file
+    void close() {
+        if(workers.size()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stop = true;
+            }
+            not_empty.notify_all();
+            for(auto& w : workers)
+                w.join();
+            workers.clear();
+        }
+        if(enc.is_open()) {
+            write_index();
             enc.write_break();
-            enc.ofs.close();
+            enc.close();
+        }
+    }
+    /**
+     * writes the chunk or queues it, in the latter case data is exchanged with an empty buffer. If dictionaries are
+     * enabled the first tx block of a stream provides its dictionary which is written ahead of the block.
+     */
+    void write_chunk(uint64_t type, byte_buffer& data, std::vector<uint64_t> const& param = {}) {
+        if(!COMPRESSED || !comp.dictionary_size || !is_tx_chunk(type)) {
+            submit(type, data, param, nullptr);
+            return;
+        }
+        auto& dict = dictionaries[param[0]];
+        if(!dict) {
+            dict = std::make_shared<compression_dict>(param[0], data.data(), data.size(), comp.dictionary_size);
+            byte_buffer content;
+            content.append(dict->content.data(), dict->content.size());
+            submit(COMP_DICT_CHUNK_ID, content, {dict->id}, nullptr);
         }
+        auto dict_param = param;
+        dict_param.push_back(dict->id);
+        submit(dict_chunk_type(type), data, dict_param, dict);
     }
 
-    void write_chunk(uint64_t type, std::vector<uint8_t> const& data, std::vector<uint64_t> const& param = {}) {
-        auto offset = COMPRESSED && type > INFO_CHUNK_ID ? 1 : 0;
-        enc.write_tag(6 + type * 2 + offset); // unassigned tags
-        if(offset || param.size()) {
-            enc.start_array(param.size() + offset + 1);
-            for(auto p : param)
+private:
+    struct job {
+        uint64_t type;
+        std::vector<uint64_t> param;
+        byte_buffer data;
+        std::shared_ptr<compression_dict const> dict;
+        byte_buffer compressed;
+        bool failed{false};
+        bool done{false};
+    };
+    unsigned const queue_depth;
+    compression comp;
+    // the jobs [0, claimed) are being compressed or done, the remaining ones wait for a worker
+    std::deque<job> queue;
+    size_t claimed{0};
+    bool writing{false};
+    // emptied buffers of written chunks, they are handed back to the producer to avoid reallocations
+    std::vector<byte_buffer> spare;
+    // destination buffers of written chunks, they are reused by later jobs
+    std::vector<byte_buffer> spare_compressed;
+    job direct;
+    compressor direct_compressor;
+    std::mutex mtx;
+    std::condition_variable not_empty, not_full;
+    bool stop{false};
+    std::vector<std::thread> workers;
+    // the compression dictionaries indexed by stream id
+    std::unordered_map<uint64_t, std::shared_ptr<compression_dict const>> dictionaries;
+    // file offsets of the written chunks, only accessed by the thread writing chunks
+    struct index_entry {
+        uint64_t type, offset, stream, start_time, end_time;
+    };
+    std::vector<index_entry> chunk_index;
+
+    void submit(uint64_t type, byte_buffer& data, std::vector<uint64_t> const& param, std::shared_ptr<compression_dict const> const& dict) {
+        if(workers.empty()) {
+            direct.type = type;
+            direct.param = param;
+            direct.dict = dict;
+            direct.data.swap(data);
+            compress(direct, direct_compressor);
+            write(direct);
+            direct.data.swap(data);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this] { return queue.size() < queue_depth; });
+        queue.emplace_back();
+        auto& j = queue.back();
+        j.type = type;
+        j.param = param;
+        j.dict = dict;
+        j.data.swap(data);
+        if(!spare.empty()) {
+            data.swap(spare.back());
+            spare.pop_back();
+        }
+        if(!spare_compressed.empty()) {
+            j.compressed.swap(spare_compressed.back());
+            spare_compressed.pop_back();
+        }
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    void run() {
+        compressor c;
+        std::unique_lock<std::mutex> lock(mtx);
+        for(;;) {
+            not_empty.wait(lock, [this] { return stop || claimed < queue.size(); });
+            if(claimed == queue.size())
+                return;
+            auto& j = queue[claimed++];
+            lock.unlock();
+            compress(j, c);
+            lock.lock();
+            j.done = true;
+            while(!writing && queue.size() && queue.front().done) {
+                writing = true;
+                auto& front = queue.front();
+                lock.unlock();
+                write(front);
+                lock.lock();
+                writing = false;
+                front.data.clear();
+                spare.emplace_back(std::move(front.data));
+                spare_compressed.emplace_back(std::move(front.compressed));
+                queue.pop_front();
+                --claimed;
+                not_full.notify_one();
+            }
+        }
+    }
+
+    void compress(job& j, compressor& c) {
+        j.failed = COMPRESSED && j.type != INFO_CHUNK_ID && !c.compress(comp, j.dict.get(), j.data, j.compressed);
+    }
+
+    void write(job const& j) {
+        // a chunk which could not be compressed fails the file like a failed write, it is not written empty
+        if(j.failed) {
+            enc.fail(EIO);
+            return;
+        }
+        if(is_tx_chunk(j.type))
+            chunk_index.push_back({j.type, enc.position(), j.param[0], j.param[1], j.param[2]});
+        else
+            chunk_index.push_back({j.type, enc.position(), 0, 0, 0});
+        auto offset = COMPRESSED && j.type > INFO_CHUNK_ID ? 1 : 0;
+        enc.write_tag(chunk_tag(j.type, offset, offset && comp.algorithm == codec::ZSTD));
+        if(offset || j.param.size()) {
+            enc.start_array(j.param.size() + offset + 1);
+            for(auto p : j.param)
                 enc.write(p);
         }
-        if(COMPRESSED && type > INFO_CHUNK_ID) {
-            enc.write(data.size());
-            const int max_dst_size = LZ4_compressBound(data.size());
-            uint8_t* compressed_data = (uint8_t*)malloc(max_dst_size);
-            const int compressed_data_size = LZ4_compress_default(reinterpret_cast<char const*>(data.data()),
-                                                                  reinterpret_cast<char*>(compressed_data), data.size(), max_dst_size);
-            enc.write(compressed_data, compressed_data_size);
-            free(compressed_data);
+        if(offset) {
+            enc.write(j.data.size());
+            enc.write(j.compressed.data(), j.compressed.size());
         } else {
-            enc.write(data.data(), data.size());
+            enc.write(j.data.data(), j.data.size());
         }
     }
+    /**
+     * writes the index chunk listing the offsets of all chunks followed by the footer chunk. The footer has a fixed
+     * size and is located right before the final break so readers find the index by reading the last 15 bytes.
+     */
+    void write_index() {
+        std::vector<index_entry const*> blocks;
+        size_t others = 0;
+        for(auto const& e : chunk_index)
+            if(is_tx_chunk(e.type))
+                blocks.push_back(&e);
+            else
+                ++others;
+        std::sort(blocks.begin(), blocks.end(), [](index_entry const* a, index_entry const* b) {
+            return std::tie(a->stream, a->start_time, a->offset) < std::tie(b->stream, b->start_time, b->offset);
+        });
+        encoder<memory_writer> content;
+        content.start_array(2);
+        content.start_array(others);
+        for(auto const& e : chunk_index)
+            if(!is_tx_chunk(e.type)) {
+                content.start_array(2);
+                content.write(e.type);
+                content.write(e.offset);
+            }
+        content.start_array(blocks.size());
+        for(auto const* e : blocks) {
+            content.start_array(4);
+            content.write(e->stream);
+            content.write(e->start_time);
+            content.write(e->end_time);
+            content.write(e->offset);
+        }
+        auto index_offset = enc.position();
+        enc.write_tag(chunk_tag(INDEX_CHUNK_ID, false));
+        enc.write(content.buffer.data(), content.buffer.size());
+        // the offset is always encoded using 8 bytes to give the footer a fixed size
+        enc.write_tag(chunk_tag(FOOTER_CHUNK_ID, false));
+        auto* p = enc.alloc(9);
+        p[0] = static_cast<uint8_t>((0 << 5) | 27);
+        auto value = to_big_endian(index_offset);
+        std::memcpy(p + 1, &value, sizeof(value));
+    }
 };
 
 struct info {
@@ -211,77 +808,203 @@ struct info {
     size_t size() { return enc.buffer.size(); }
 };
 
-struct char_equal_to : public std::equal_to<char const*> {
-    bool operator()(char const* __x, char const* __y) const { return strcmp(__x, __y) == 0; }
-};
+namespace detail {
+// 64x64 bit multiplication returning the low and high half of the product in a and b
+inline void mum(uint64_t& a, uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t const ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64_t const rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+    uint64_t const lo = t + (rm1 << 32);
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+    a = lo;
+#endif
+}
 
-struct char_hash {
-    // BKDR hash algorithm
-    std::size_t operator()(char const* str) const {
-        constexpr unsigned int seed = 131; // 31  131 1313 13131131313 etc//
-        std::size_t hash = 0;
-        while(*str) {
-            hash = (hash * seed) + (*str);
-            str++;
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    mum(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(uint8_t const* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(uint8_t const* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+} // namespace detail
+/**
+ * hash of a length delimited byte sequence following wyhash: the input is consumed in 8 byte words which are combined
+ * using 64x64->128 bit multiplications, keys of up to 16 bytes need no loop at all.
+ */
+inline uint64_t hash_bytes(char const* data, size_t len, uint64_t seed = 0) {
+    using namespace detail;
+    constexpr uint64_t p0 = 0xa0761d6478bd642full, p1 = 0xe7037ed1a0b428dbull, p2 = 0x8ebc6af09c88c6e3ull, p3 = 0x589965cc75374cc3ull;
+    auto const* p = reinterpret_cast<uint8_t const*>(data);
+    seed ^= mix(seed ^ p0, p1);
+    uint64_t a, b;
+    if(len <= 16) {
+        if(len >= 4) {
+            auto const off = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + off);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - off);
+        } else if(len > 0) {
+            a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+            b = 0;
+        } else
+            a = b = 0;
+    } else {
+        auto i = len;
+        if(i > 48) {
+            auto see1 = seed, see2 = seed;
+            do {
+                seed = mix(read64(p) ^ p1, read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ p2, read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ p3, read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= see1 ^ see2;
         }
-        return hash;
+        while(i > 16) {
+            seed = mix(read64(p) ^ p1, read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
     }
-};
-
+    a ^= p1;
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ p0 ^ len, b ^ p1);
+}
+/**
+ * string dictionary assigning consecutive keys to strings, key 0 is the empty string. The strings are copied into an
+ * arena of large blocks and looked up using an open addressing table with linear probing which stores the hash of
+ * each string so probes only compare the strings if the hashes match.
+ */
 struct dictionary {
-    std::deque<std::string> out_dict{""};
-    std::unordered_map<char const*, size_t, char_hash, char_equal_to> lut;
-    size_t flushed_idx{0}, unflushed_size{1};
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
 
-    size_t get_key(nonstd::string_view const& str) {
-        if(!str.length())
-            return 0;
-        auto it = lut.find(str.data());
-        if(it != std::end(lut))
-            return it->second;
-        out_dict.push_back(nonstd::to_string(str));
-        lut.insert({out_dict.back().c_str(), out_dict.size() - 1});
-        unflushed_size += str.size();
-        return out_dict.size() - 1;
+    dictionary()
+    : strings{{"", 0}} {}
+    /// number of strings including the empty one
+    size_t size() const { return strings.size(); }
+    /// key of the string or npos if it is not in the dictionary
+    size_t find_key(nonstd::string_view const& str) const {
+        return str.size() ? find(hash_bytes(str.data(), str.size()), str.data(), str.size()) : 0;
     }
 
-    size_t get_key(char const* str) {
-        if(!strlen(str))
-            return 0;
-        auto it = lut.find(str);
-        if(it != std::end(lut))
-            return it->second;
-        out_dict.push_back(std::string(str));
-        lut.insert({out_dict.back().c_str(), out_dict.size() - 1});
-        unflushed_size += out_dict.back().size();
-        return out_dict.size() - 1;
-    }
+    size_t get_key(nonstd::string_view const& str) { return get_key(str.data(), str.size()); }
 
-    size_t get_key(std::string const& str) {
-        if(!str.length())
+    size_t get_key(char const* str) { return get_key(str, strlen(str)); }
+
+    size_t get_key(std::string const& str) { return get_key(str.data(), str.size()); }
+
+    size_t get_key(char const* str, size_t len) {
+        if(!len)
             return 0;
-        auto it = lut.find(str.c_str());
-        if(it != std::end(lut))
-            return it->second;
-        out_dict.push_back(str);
-        lut.insert({out_dict.back().c_str(), out_dict.size() - 1});
-        unflushed_size += str.size();
-        return out_dict.size() - 1;
+        auto const hash = hash_bytes(str, len);
+        auto const key = find(hash, str, len);
+        if(key != npos)
+            return key;
+        if(2 * (strings.size() + 1) > slots.size())
+            grow();
+        auto const mask = slots.size() - 1;
+        auto i = hash & mask;
+        while(slots[i].key)
+            i = (i + 1) & mask;
+        slots[i] = {hash, strings.size()};
+        strings.push_back({store(str, len), len});
+        unflushed_size += len;
+        return strings.size() - 1;
     }
 
     template <bool COMPRESSED> void flush(chunk_writer<COMPRESSED>& cw) {
         if(!unflushed_size)
             return;
         encoder<memory_writer> enc;
-        enc.start_map(out_dict.size() - flushed_idx);
-        for(auto i = flushed_idx; i < out_dict.size(); ++i) {
+        enc.start_map(strings.size() - flushed_idx);
+        for(auto i = flushed_idx; i < strings.size(); ++i) {
             enc.write(i);
-            enc.write(out_dict[i]);
+            enc.write_text(strings[i].data, strings[i].len);
         }
         cw.write_chunk(DICT_CHUNK_ID, enc.buffer);
-        flushed_idx = out_dict.size();
+        flushed_idx = strings.size();
         unflushed_size = 0;
     }
+
+private:
+    enum { ARENA_BLOCK_SIZE = 1 << 16 };
+    struct string_ref {
+        char const* data;
+        size_t len;
+    };
+    struct slot {
+        uint64_t hash;
+        size_t key; // 0 denotes an empty slot
+    };
+    // the strings indexed by their key
+    std::vector<string_ref> strings;
+    std::vector<slot> slots;
+    std::vector<std::unique_ptr<char[]>> arena;
+    size_t arena_free{0};
+    size_t flushed_idx{0}, unflushed_size{1};
+
+    size_t find(uint64_t hash, char const* str, size_t len) const {
+        if(slots.empty())
+            return npos;
+        auto const mask = slots.size() - 1;
+        for(auto i = hash & mask;; i = (i + 1) & mask) {
+            auto const& s = slots[i];
+            if(!s.key)
+                return npos;
+            if(s.hash == hash && strings[s.key].len == len && !std::memcmp(strings[s.key].data, str, len))
+                return s.key;
+        }
+    }
+    // copies the string into the arena, strings exceeding a block get a block of their own
+    char const* store(char const* str, size_t len) {
+        char* dst;
+        if(len > ARENA_BLOCK_SIZE / 4) {
+            arena.emplace_back(new char[len]);
+            dst = arena.back().get();
+            // keep filling the current block
+            if(arena.size() > 1)
+                std::swap(arena.back(), arena[arena.size() - 2]);
+        } else {
+            if(len > arena_free) {
+                arena.emplace_back(new char[ARENA_BLOCK_SIZE]);
+                arena_free = ARENA_BLOCK_SIZE;
+            }
+            dst = arena.back().get() + ARENA_BLOCK_SIZE - arena_free;
+            arena_free -= len;
+        }
+        std::memcpy(dst, str, len);
+        return dst;
+    }
+
+    void grow() {
+        std::vector<slot> old(std::max<size_t>(slots.size() * 2, 64), slot{0, 0});
+        old.swap(slots);
+        auto const mask = slots.size() - 1;
+        for(auto const& s : old)
+            if(s.key) {
+                auto i = s.hash & mask;
+                while(slots[i].key)
+                    i = (i + 1) & mask;
+                slots[i] = s;
+            }
+    }
 };
 
 struct directory {
@@ -328,11 +1051,11 @@ struct relations {
     relations(dictionary& dict)
     : dict(dict) {}
 
-    template <typename N> inline void add_relation(N const& name, unsigned from_stream, uint64_t from, unsigned to_stream, uint64_t to) {
+    inline void add_relation(uint64_t name_key, unsigned from_stream, uint64_t from, unsigned to_stream, uint64_t to) {
         if(enc.is_empty())
             enc.start_array();
         enc.start_array(5);
-        enc.write(dict.get_key(name));
+        enc.write(name_key);
         enc.write(from);
         enc.write(to);
         enc.write(from_stream);
@@ -358,62 +1081,241 @@ struct tx_entry {
     uint64_t generator{0};
     uint64_t stream_id{0};
     uint64_t start_time{0}, end_time{0};
+    bool active{false};
+    // for columnar tx blocks enc holds the bare values, the other fields of the attributes are kept here
+    bool columnar{false};
+    struct attribute {
+        uint64_t type, name_id, type_id;
+        size_t offset; // start of the value in enc
+    };
+    std::vector<attribute> attributes;
 
     void reset() {
         enc.clear();
+        attributes.clear();
         elem_count = 0;
         start_time = 0;
         end_time = 0;
     }
 
     template <typename T> void add_attribute(uint64_t type, uint64_t name_id, uint64_t type_id, T value) {
-        enc.write_tag(7 + type);
-        enc.start_array(3);
-        enc.write(name_id);
-        enc.write(type_id);
-        enc.write(value);
+        if(columnar) {
+            attributes.push_back({type, name_id, type_id, enc.buffer.size()});
+            enc.write(value);
+        } else
+            write_attribute(enc, type, name_id, type_id, value);
         elem_count++;
     }
 
-    void append_to(encoder<memory_writer>& out) {
-        out.start_array(elem_count + 1);
-        out.write_tag(6);
-        out.start_array(4);
-        out.write(id);
-        out.write(generator);
-        out.write(start_time);
-        out.write(end_time);
-        out.append(enc);
+    template <typename T>
+    static void write_attribute(encoder<memory_writer>& out, uint64_t type, uint64_t name_id, uint64_t type_id, T value) {
+        out.write_tag(7 + type);
+        out.start_array(3);
+        out.write(name_id);
+        out.write(type_id);
+        out.write(value);
     }
 };
 
+/**
+ * buffer of the transactions of a stream. Row based formats encode each transaction as an array of its header and
+ * attributes. The columnar format stores ids, generators, start and end times in fixed size columns and the values of
+ * each attribute (identified by event, name and data type) in a column of its own together with their row numbers.
+ */
 struct tx_block {
     encoder<memory_writer> enc;
     dictionary& dict;
     const uint64_t stream_id;
     uint64_t start_time{std::numeric_limits<uint64_t>::max()}, end_time{0};
-    tx_block(dictionary& dict, uint64_t stream_id)
+    // incremented with every flush, it identifies the current content of the block
+    uint64_t generation{0};
+    // size already counted towards the buffered bytes of the writer
+    size_t accounted{0};
+    const block_format format;
+    // header of the previous transaction in the block, delta encoded headers refer to it
+    uint64_t prev_id{0}, prev_generator{0}, prev_start{0};
+    tx_block(dictionary& dict, uint64_t stream_id, block_format format = block_format::DELTA)
     : dict(dict)
-    , stream_id(stream_id) {}
+    , stream_id(stream_id)
+    , format(format) {}
 
     void append(tx_entry& e) {
+        start_entry(e.id, e.generator, e.start_time, e.end_time, e.elem_count);
+        if(format != block_format::COLUMNAR) {
+            enc.append(e.enc);
+            return;
+        }
+        auto const* values = e.enc.buffer.data();
+        for(size_t i = 0, n = e.attributes.size(); i < n; ++i) {
+            auto const& a = e.attributes[i];
+            auto end = i + 1 < n ? e.attributes[i + 1].offset : e.enc.buffer.size();
+            auto& c = get_column(a.type, a.name_id, a.type_id);
+            c.values.push(values + a.offset, end - a.offset);
+            column_bytes += end - a.offset;
+        }
+    }
+    // starts a transaction encoded in place, exactly attr_count calls of add_attribute() need to follow
+    void start_entry(uint64_t id, uint64_t generator, uint64_t start, uint64_t end, size_t attr_count) {
+        start_time = std::min(start_time, start);
+        end_time = std::max(end_time, end);
+        if(format == block_format::COLUMNAR) {
+            put(ids, id - prev_id);
+            put(generators, generator);
+            put(starts, start - prev_start);
+            put(ends, end - start);
+            prev_id = id;
+            prev_start = start;
+            ++row_count;
+            column_bytes += 4 * sizeof(uint64_t);
+            return;
+        }
         if(enc.is_empty())
             enc.start_array();
-        e.append_to(enc);
-        start_time = std::min(start_time, e.start_time);
-        end_time = std::max(end_time, e.end_time);
+        enc.start_array(attr_count + 1);
+        enc.write_tag(6);
+        enc.start_array(4);
+        if(format == block_format::DELTA) {
+            // the differences wrap around so they are exact even if a field decreases
+            enc.write(static_cast<int64_t>(id - prev_id));
+            enc.write(static_cast<int64_t>(generator - prev_generator));
+            enc.write(static_cast<int64_t>(start - prev_start));
+            enc.write(static_cast<int64_t>(end - start));
+            prev_id = id;
+            prev_generator = generator;
+            prev_start = start;
+        } else {
+            enc.write(id);
+            enc.write(generator);
+            enc.write(start);
+            enc.write(end);
+        }
+    }
+
+    template <typename T> void add_attribute(uint64_t type, uint64_t name_id, uint64_t type_id, T value) {
+        if(format != block_format::COLUMNAR) {
+            tx_entry::write_attribute(enc, type, name_id, type_id, value);
+            return;
+        }
+        auto& c = get_column(type, name_id, type_id);
+        auto size = c.values.buffer.size();
+        c.values.write(value);
+        column_bytes += c.values.buffer.size() - size;
     }
 
     template <bool COMPRESSED> void flush(chunk_writer<COMPRESSED>& cw) {
-        if(enc.is_empty())
+        if(!size())
             return;
         dict.flush(cw);
-        enc.write_break();
-        cw.write_chunk(TX_CHUNK_ID, enc.buffer, {stream_id, start_time, end_time});
+        if(format == block_format::COLUMNAR)
+            write_columns();
+        else
+            enc.write_break();
+        auto type = format == block_format::PLAIN ? TX_CHUNK_ID : format == block_format::DELTA ? DELTA_TX_CHUNK_ID : COLUMNAR_TX_CHUNK_ID;
+        cw.write_chunk(type, enc.buffer, {stream_id, start_time, end_time});
         enc.buffer.clear();
+        start_time = std::numeric_limits<uint64_t>::max();
+        end_time = 0;
+        prev_id = prev_generator = prev_start = 0;
+        ++generation;
     }
 
-    size_t size() { return enc.buffer.size(); }
+    size_t size() { return format == block_format::COLUMNAR ? column_bytes : enc.buffer.size(); }
+
+private:
+    struct column {
+        uint64_t type, name_id, type_id;
+        byte_buffer rows;
+        encoder<memory_writer> values;
+        size_t count{0};
+    };
+    byte_buffer ids, generators, starts, ends, scratch;
+    // the columns used by the last block keep their buffers for the next one, the others are dropped by a flush
+    std::vector<column> columns;
+    // index into columns by column_key()
+    std::unordered_map<uint64_t, size_t> column_index;
+    size_t next_column{0};
+    uint32_t row_count{0};
+    size_t column_bytes{0};
+
+    static void put(byte_buffer& buffer, uint64_t value) {
+        auto* out = buffer.grow(sizeof(value));
+        for(unsigned i = 0; i < sizeof(value); ++i)
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    // the event takes 2 and the data type 6 bits
+    static uint64_t column_key(uint64_t type, uint64_t name_id, uint64_t type_id) { return name_id << 8 | type << 6 | type_id; }
+    // returns the column of the attribute and appends the current row to it
+    column& get_column(uint64_t type, uint64_t name_id, uint64_t type_id) {
+        // transactions mostly carry the same attributes in the same order so the column after the last one is tried first
+        auto idx = next_column;
+        if(idx >= columns.size() || columns[idx].name_id != name_id || columns[idx].type != type || columns[idx].type_id != type_id) {
+            auto res = column_index.emplace(column_key(type, name_id, type_id), columns.size());
+            idx = res.first->second;
+            if(res.second) {
+                columns.emplace_back();
+                columns.back().type = type;
+                columns.back().name_id = name_id;
+                columns.back().type_id = type_id;
+            }
+        }
+        next_column = idx + 1;
+        auto& c = columns[idx];
+        auto const row = row_count - 1;
+        auto* out = c.rows.grow(sizeof(row));
+        for(unsigned i = 0; i < sizeof(row); ++i)
+            out[i] = static_cast<uint8_t>(row >> (8 * i));
+        ++c.count;
+        column_bytes += sizeof(row);
+        return c;
+    }
+
+    /**
+     * writes the little endian values of a column as byte string storing the bytes of equal significance together,
+     * the mostly zero upper bytes of the small differences then form long runs which compress well
+     */
+    void write_column(byte_buffer const& column, size_t width) {
+        auto const n = column.size() / width;
+        scratch.clear();
+        auto* out = scratch.grow(column.size());
+        auto const* in = column.data();
+        for(size_t j = 0; j < width; ++j)
+            for(size_t k = 0; k < n; ++k)
+                out[j * n + k] = in[k * width + j];
+        enc.write(scratch.data(), scratch.size());
+    }
+
+    void write_columns() {
+        // columns without values in this block are neither written nor kept
+        columns.erase(std::remove_if(columns.begin(), columns.end(), [](column const& c) { return !c.count; }), columns.end());
+        column_index.clear();
+        for(size_t i = 0; i < columns.size(); ++i)
+            column_index.emplace(column_key(columns[i].type, columns[i].name_id, columns[i].type_id), i);
+        enc.start_array(5);
+        write_column(ids, sizeof(uint64_t));
+        write_column(generators, sizeof(uint64_t));
+        write_column(starts, sizeof(uint64_t));
+        write_column(ends, sizeof(uint64_t));
+        enc.start_array(columns.size());
+        for(auto& c : columns) {
+            enc.start_array(5);
+            enc.write(7 + c.type);
+            enc.write(c.name_id);
+            enc.write(c.type_id);
+            write_column(c.rows, sizeof(uint32_t));
+            enc.start_array(c.count);
+            enc.append(c.values);
+            c.rows.clear();
+            c.values.clear();
+            c.count = 0;
+        }
+        ids.clear();
+        generators.clear();
+        starts.clear();
+        ends.clear();
+        row_count = 0;
+        column_bytes = 0;
+        next_column = 0;
+    }
 };
 
 /**
@@ -446,19 +1348,56 @@ struct tx_block {
  *       cbor tag(12) uncompressed
  *       array(4)
  *         unsigned - stream id
- *         unsigned - start_time
- *         unsigned - end_time
+ *         unsigned - start_time (in the unit written to the info chunk)
+ *         unsigned - end_time (in the unit written to the info chunk)
  *         bytes() - content
  *       cbor tag(13) compressed
  *       array(5)
  *         unsigned - stream id
- *         unsigned - start_time
- *         unsigned - end_time
+ *         unsigned - start_time (in the unit written to the info chunk)
+ *         unsigned - end_time (in the unit written to the info chunk)
  *         unsigned - uncompressed data size
  *         bytes() - content
  *     chunk type 4 (tx relationships)
  *       cbor tag(14) (compressed: 15)
  *       bytes() - content
+ *     chunk type 5 (compression dictionary of a stream)
+ *       cbor tag(0x4654520b) compressed
+ *       array(3)
+ *         unsigned - dictionary id
+ *         unsigned - uncompressed size
+ *         bytes() - content
+ *     chunk type 6 (tx block compressed using a compression dictionary)
+ *       cbor tag(0x4654520d) compressed
+ *       array(6)
+ *         unsigned - stream id
+ *         unsigned - start_time (in the unit written to the info chunk)
+ *         unsigned - end_time (in the unit written to the info chunk)
+ *         unsigned - dictionary id
+ *         unsigned - uncompressed data size
+ *         bytes() - content
+ *     chunk type 9 (tx block with delta encoded transaction headers)
+ *       cbor tag(0x46545212) uncompressed, cbor tag(0x46545213) compressed
+ *       same layout as chunk type 3
+ *     chunk type 10 (tx block with delta encoded transaction headers compressed using a compression dictionary)
+ *       cbor tag(0x46545215) compressed
+ *       same layout as chunk type 6
+ *     chunk type 11 (columnar tx block)
+ *       cbor tag(0x46545216) uncompressed, cbor tag(0x46545217) compressed
+ *       same layout as chunk type 3
+ *     chunk type 12 (columnar tx block compressed using a compression dictionary)
+ *       cbor tag(0x46545219) compressed
+ *       same layout as chunk type 6
+ *     chunk type 7 (index, written when closing the file)
+ *       cbor tag(0x4654520e) uncompressed
+ *       bytes() - content
+ *     chunk type 8 (footer, last chunk of the file)
+ *       cbor tag(0x46545210)
+ *       unsigned - file offset of the index chunk, always encoded using 8 bytes
+ *     compressed chunks use LZ4 (fast or HC). zstd compressed chunks use the same layout with the tag
+ *     0x46545200 + 2 * chunk type + 33 (dictionary 0x46545223, directory 0x46545225, tx block 0x46545227,
+ *     tx relationships 0x46545229, delta encoded tx block 0x46545233, columnar tx block 0x46545237)
+ *     the tags of the chunk types 5 and above are 0x46545200 + 2 * chunk type (+ 1 if compressed), see chunk_tag()
  * -----------------------------------------
  * chunk content formats:
  * 	- chunk type 1
@@ -482,23 +1421,54 @@ struct tx_block {
  *        array(4)
  *          unsigned - id
  *          unsigned - generator id
- *          unsigned - start time (in ps)
- *          unsigned - end time (in ps)
+ *          unsigned - start time (in the unit written to the info chunk)
+ *          unsigned - end time (in the unit written to the info chunk)
  *       cbor tag(7)
  *       array(3) - attribute at begin of tx
  *         unsigned - name (id of string)
  *         unsigned - data_type
- *         [signed, unsigned, double] - value (depending of type)
+ *         [signed, unsigned, double, array(2)] - value (depending of type)
  *       cbor tag(8)
  *       array(3) - attribute at tx
  *         unsigned - name (id of string)
  *         unsigned - data_type
- *         [signed, unsigned, double] - value (depending of type)
+ *         [signed, unsigned, double, array(2)] - value (depending of type)
  *       cbor tag(9)
  *       array(3) - attribute at end of tx
  *         unsigned - name (id of string)
  *         unsigned - data_type
- *         [signed, unsigned, double] - value (depending of type)
+ *         [signed, unsigned, double, string, array(2)] - value (depending of type)
+ *       strings are unsigned (id of string)
+ *       bit and logic vectors are unsigned (id of the string of '0', '1', 'Z' and 'X', the most significant position
+ *       first)
+ *  - chunk of type 9 and 10
+ *    same as chunk type 3 except the encoding of values and the time stamps of a transaction which are signed
+ *    differences:
+ *        signed - id minus the id of the preceding transaction in the block
+ *        signed - generator id minus the generator id of the preceding transaction in the block
+ *        signed - start time minus the start time of the preceding transaction in the block
+ *        signed - end time minus start time
+ *      the first transaction of a block refers to 0 for all fields
+ *    strings are unsigned (id of string) or, once their attribute name added max_distinct_strings strings to the
+ *    dictionary, string (the text inline)
+ *    bit and logic vectors are array(2)
+ *      unsigned - number of positions
+ *      bytes() - 1 (bit vector) or 2 (logic vector, 0, 1, Z, X) bits per position, position 0 in the lowest bits
+ *  - chunk of type 11 and 12
+ *    array(5)
+ *      bytes() - ids minus the id of the preceding transaction in the block, 8 bytes per transaction
+ *      bytes() - generator ids, 8 bytes per transaction
+ *      bytes() - start times minus the start time of the preceding transaction in the block, 8 bytes per transaction
+ *      bytes() - end times minus start times, 8 bytes per transaction
+ *      array(*) - attribute columns
+ *        array(5)
+ *          unsigned - 7, 8 or 9 (begin, record or end attribute)
+ *          unsigned - name (id of string)
+ *          unsigned - data_type
+ *          bytes() - index of the transaction of each value, 4 bytes per value
+ *          array(*) - values, encoded as in chunk type 9
+ *    the bytes() columns hold little endian numbers stored byte plane wise: the least significant bytes of all
+ *    numbers first, followed by the next significant bytes and so on
  *  - chunk of type 4
  *    array(*) - list of relations
  *      array(5) - relation:
@@ -507,9 +1477,23 @@ struct tx_block {
  *        uint64_t - sink tx id
  *        unsigned - source stream id
  *        unsigned - sink stream id
+ *  - chunk of type 7
+ *    array(2)
+ *      array() - non tx block chunks in file order
+ *        array(2)
+ *          unsigned - chunk type
+ *          unsigned - file offset
+ *      array() - tx block chunks sorted by stream id and start time
+ *        array(4)
+ *          unsigned - stream id
+ *          unsigned - start_time (in the unit written to the info chunk)
+ *          unsigned - end_time (in the unit written to the info chunk)
+ *          unsigned - file offset
  *
  */
 enum class event_type { BEGIN, RECORD, END };
+/// attribute index of begin and end attributes whose names are not determined by the generator and the index
+constexpr unsigned no_index = std::numeric_limits<unsigned>::max();
 enum class data_type {
     BOOLEAN,                      // bool
     ENUMERATION,                  // enum
@@ -534,27 +1518,57 @@ template <bool COMPRESSED = false> struct ftr_writer {
     directory dir{dict};
     relations rel{dict};
     std::vector<std::unique_ptr<tx_block>> fiber_blocks;
+    // per generator and begin/end event the dictionary keys of the attribute names indexed by attribute position
+    std::vector<std::array<std::vector<size_t>, 2>> generator_attr_names;
     std::unordered_map<uint64_t, tx_entry*> txs;
     std::deque<tx_entry> entry_storage;
     std::vector<tx_entry*> free_pool;
+    // target of writeTransactionAttribute()
+    tx_block* complete_tx_block{nullptr};
+    uint64_t complete_tx_generator{0};
+    uint64_t complete_tx_time{0};
+    // appends still expected for the transaction started by writeTransaction(), its header counts as one
+    size_t complete_tx_pending{0};
+    block_policy policy;
+    // non-empty tx blocks in the order they received their first transaction
+    struct open_block {
+        tx_block* block;
+        uint64_t generation;
+        uint64_t time;
+    };
+    std::deque<open_block> open_blocks;
+    size_t buffered{0};
+    // number of strings added to the dictionary by the values of an attribute indexed by the key of its name
+    std::vector<size_t> distinct_strings;
+    // bit and logic vectors of PLAIN blocks as text
+    std::string vector_text;
 
-    ftr_writer(const std::string& name)
-    : cw(name) {}
+    ftr_writer(const std::string& name, size_t buffer_size = DEFAULT_FILE_BUFFER_SIZE, unsigned queue_depth = 0, unsigned threads = 1,
+               compression comp = {}, block_policy policy = {})
+    : cw(name, buffer_size, queue_depth, threads, comp)
+    , policy(policy) {}
 
-    ~ftr_writer() {
+    ~ftr_writer() { close(); }
+    /// writes all buffered data and closes the file, open transactions end at their start time
+    void close() {
+        if(!cw.enc.is_open())
+            return;
         dict.flush(cw);
         dir.flush(cw);
-        for(auto& t : txs) {
-            auto e = t.second;
-            e->end_time = e->start_time;
-            fiber_blocks[e->stream_id].get()->append(*e);
-        }
+        for(auto& e : entry_storage)
+            if(e.active) {
+                e.end_time = e.start_time;
+                fiber_blocks[e.stream_id].get()->append(e);
+            }
         txs.clear();
         for(auto& block : fiber_blocks)
             if(block)
                 block->flush(cw);
         rel.flush(cw);
+        cw.close();
     }
+    /// errno of the first failed write to the file, EIO if a chunk could not be compressed, or 0. Valid after close()
+    int error() const { return cw.enc.error(); }
 
     inline void writeInfo(int8_t timescale) {
         inf.add_time_scale(timescale);
@@ -565,12 +1579,20 @@ template <bool COMPRESSED = false> struct ftr_writer {
         dir.add_stream(id, name, kind);
         if(id >= fiber_blocks.size())
             fiber_blocks.resize(id + 1);
-        fiber_blocks[id].reset(new tx_block(dict, id));
+        fiber_blocks[id].reset(new tx_block(dict, id, policy.format));
     }
 
-    inline void writeGenerator(uint64_t id, std::string const& name, uint64_t stream) { dir.add_generator(id, name, stream); }
+    inline void writeGenerator(uint64_t id, std::string const& name, uint64_t stream) {
+        dir.add_generator(id, name, stream);
+        if(id >= generator_attr_names.size())
+            generator_attr_names.resize(id + 1);
+    }
 
-    inline void startTransaction(uint64_t id, uint64_t generator, uint64_t stream, uint64_t time) {
+    /**
+     * starts a transaction and returns its entry. The entry is passed to writeAttribute() and endTransaction() which
+     * avoids looking up the transaction by its id, it stays valid until endTransaction() is called.
+     */
+    inline tx_entry* beginTransaction(uint64_t id, uint64_t generator, uint64_t stream, uint64_t time) {
         if(dir.size())
             dir.flush(cw);
         if(free_pool.empty()) {
@@ -579,47 +1601,239 @@ template <bool COMPRESSED = false> struct ftr_writer {
         }
         auto* e = free_pool.back();
         free_pool.pop_back();
-        txs[id] = e;
         e->id = id;
         e->generator = generator;
         e->stream_id = stream;
         e->start_time = time;
+        e->active = true;
+        e->columnar = policy.format == block_format::COLUMNAR;
+        return e;
     }
 
-    inline void endTransaction(uint64_t id, uint64_t time) {
-        auto e = txs[id];
+    inline void endTransaction(tx_entry* e, uint64_t time) {
         e->end_time = time;
         auto* block = fiber_blocks[e->stream_id].get();
+        if(block->size() == 0)
+            open(block, time);
         block->append(*e);
-        if(block->size() > MAX_TXBUFFER_SIZE) {
-            block->flush(cw);
-        }
-        txs.erase(id);
+        if(block->size() > policy.block_size)
+            flush_block(block);
+        else
+            limit_buffered(block, time);
         e->reset();
+        e->active = false;
         free_pool.push_back(e);
     }
 
     template <typename N>
-    inline void writeAttribute(uint64_t id, event_type event, N const& name, data_type type, const std::string& value) {
-        txs[id]->add_attribute(static_cast<uint64_t>(event), dict.get_key(name), static_cast<uint64_t>(type), dict.get_key(value));
+    inline void writeAttribute(tx_entry* e, event_type event, unsigned idx, N const& name, data_type type, const std::string& value) {
+        writeAttribute(e, event, idx, name, type, nonstd::string_view(value));
+    }
+
+    template <typename N>
+    inline void writeAttribute(tx_entry* e, event_type event, unsigned idx, N const& name, data_type type, const char* value) {
+        writeAttribute(e, event, idx, name, type, nonstd::string_view(value));
+    }
+
+    template <typename N>
+    inline void writeAttribute(tx_entry* e, event_type event, unsigned idx, N const& name, data_type type,
+                               nonstd::string_view const& value) {
+        auto name_key = get_name_key(e->generator, event, idx, name);
+        auto value_key = get_value_key(name_key, value);
+        if(value_key != dictionary::npos)
+            e->add_attribute(static_cast<uint64_t>(event), name_key, static_cast<uint64_t>(type), static_cast<uint64_t>(value_key));
+        else
+            e->add_attribute(static_cast<uint64_t>(event), name_key, static_cast<uint64_t>(type), value);
+    }
+
+    template <typename N>
+    inline void writeAttribute(tx_entry* e, event_type event, unsigned idx, N const& name, data_type type, packed_vector const& value) {
+        if(policy.format == block_format::PLAIN) {
+            to_text(value, type == data_type::LOGIC_VECTOR ? 2 : 1, vector_text);
+            writeAttribute(e, event, idx, name, type, nonstd::string_view(vector_text));
+        } else
+            e->add_attribute(static_cast<uint64_t>(event), get_name_key(e->generator, event, idx, name), static_cast<uint64_t>(type),
+                             value);
+    }
+
+    template <typename N, typename T>
+    inline void writeAttribute(tx_entry* e, event_type event, unsigned idx, N const& name, data_type type, T value) {
+        e->add_attribute(static_cast<uint64_t>(event), get_name_key(e->generator, event, idx, name), static_cast<uint64_t>(type), value);
+    }
+    // variants identifying the transaction by its id
+    inline void startTransaction(uint64_t id, uint64_t generator, uint64_t stream, uint64_t time) {
+        txs[id] = beginTransaction(id, generator, stream, time);
+    }
+
+    // true if the transaction was started by startTransaction() and not yet ended
+    inline bool hasTransaction(uint64_t id) const { return txs.find(id) != txs.end(); }
+    // returns false and writes nothing if the transaction is unknown
+    inline bool endTransaction(uint64_t id, uint64_t time) {
+        auto it = txs.find(id);
+        if(it == txs.end())
+            return false;
+        endTransaction(it->second, time);
+        txs.erase(it);
+        return true;
     }
 
-    template <typename N> inline void writeAttribute(uint64_t id, event_type event, N const& name, data_type type, const char* value) {
-        txs[id]->add_attribute(static_cast<uint64_t>(event), dict.get_key(name), static_cast<uint64_t>(type),
-                               dict.get_key(nonstd::string_view(value)));
+    template <typename N, typename T>
+    inline bool writeAttribute(uint64_t id, event_type event, unsigned idx, N const& name, data_type type, T const& value) {
+        auto it = txs.find(id);
+        if(it == txs.end())
+            return false;
+        writeAttribute(it->second, event, idx, name, type, value);
+        return true;
+    }
+    /**
+     * writes a complete transaction directly into the tx block of its stream without going through a tx_entry. It
+     * needs to be followed by exactly attr_count calls of writeTransactionAttribute().
+     */
+    inline void writeTransaction(uint64_t id, uint64_t generator, uint64_t stream, uint64_t start_time, uint64_t end_time,
+                                 size_t attr_count) {
+        if(dir.size())
+            dir.flush(cw);
+        complete_tx_block = fiber_blocks[stream].get();
+        complete_tx_generator = generator;
+        complete_tx_time = start_time;
+        if(complete_tx_block->size() == 0)
+            open(complete_tx_block, start_time);
+        complete_tx_block->start_entry(id, generator, start_time, end_time, attr_count);
+        complete_tx_pending = attr_count + 1;
+        complete_tx_appended();
     }
 
-    template <typename N, typename T> inline void writeAttribute(uint64_t id, event_type event, N const& name, data_type type, T value) {
-        txs[id]->add_attribute(static_cast<uint64_t>(event), dict.get_key(name), static_cast<uint64_t>(type), value);
+    template <typename N>
+    inline void writeTransactionAttribute(event_type event, unsigned idx, N const& name, data_type type, const std::string& value) {
+        writeTransactionAttribute(event, idx, name, type, nonstd::string_view(value));
+    }
+
+    template <typename N>
+    inline void writeTransactionAttribute(event_type event, unsigned idx, N const& name, data_type type, const char* value) {
+        writeTransactionAttribute(event, idx, name, type, nonstd::string_view(value));
+    }
+
+    template <typename N>
+    inline void writeTransactionAttribute(event_type event, unsigned idx, N const& name, data_type type,
+                                          nonstd::string_view const& value) {
+        auto name_key = get_name_key(complete_tx_generator, event, idx, name);
+        auto value_key = get_value_key(name_key, value);
+        if(value_key != dictionary::npos)
+            complete_tx_block->add_attribute(static_cast<uint64_t>(event), name_key, static_cast<uint64_t>(type),
+                                             static_cast<uint64_t>(value_key));
+        else
+            complete_tx_block->add_attribute(static_cast<uint64_t>(event), name_key, static_cast<uint64_t>(type), value);
+        complete_tx_appended();
+    }
+
+    template <typename N>
+    inline void writeTransactionAttribute(event_type event, unsigned idx, N const& name, data_type type, packed_vector const& value) {
+        if(policy.format == block_format::PLAIN) {
+            to_text(value, type == data_type::LOGIC_VECTOR ? 2 : 1, vector_text);
+            writeTransactionAttribute(event, idx, name, type, nonstd::string_view(vector_text));
+        } else {
+            complete_tx_block->add_attribute(static_cast<uint64_t>(event), get_name_key(complete_tx_generator, event, idx, name),
+                                             static_cast<uint64_t>(type), value);
+            complete_tx_appended();
+        }
+    }
+
+    template <typename N, typename T>
+    inline void writeTransactionAttribute(event_type event, unsigned idx, N const& name, data_type type, T value) {
+        auto name_key = get_name_key(complete_tx_generator, event, idx, name);
+        complete_tx_block->add_attribute(static_cast<uint64_t>(event), name_key, static_cast<uint64_t>(type), value);
+        complete_tx_appended();
     }
 
     template <typename N>
     inline void writeRelation(N const& name, uint64_t sink_stream_id, uint64_t sink_tx_id, uint64_t src_stream_id, uint64_t src_tx_id) {
-        rel.add_relation(name, src_stream_id, src_tx_id, sink_stream_id, sink_tx_id);
+        writeRelation(getRelationKey(name), sink_stream_id, sink_tx_id, src_stream_id, src_tx_id);
+    }
+    /// returns the dictionary key of a relation name, it stays valid for the lifetime of the writer
+    template <typename N> inline uint64_t getRelationKey(N const& name) { return dict.get_key(name); }
+
+    inline void writeRelation(uint64_t name_key, uint64_t sink_stream_id, uint64_t sink_tx_id, uint64_t src_stream_id, uint64_t src_tx_id) {
+        rel.add_relation(name_key, src_stream_id, src_tx_id, sink_stream_id, sink_tx_id);
         if(rel.size() > MAX_REL_SIZE) {
             rel.flush(cw);
         }
     }
+
+private:
+    inline void open(tx_block* block, uint64_t time) {
+        if(policy.memory_budget || policy.max_age)
+            open_blocks.push_back({block, block->generation, time});
+    }
+
+    inline void flush_block(tx_block* block) {
+        buffered -= block->accounted;
+        block->accounted = 0;
+        block->flush(cw);
+    }
+    /**
+     * accounts every append of writeTransaction() and writeTransactionAttribute(). Once the transaction is complete its
+     * block is written if it exceeds block_size, before that the block cannot be written but other ones can.
+     */
+    inline void complete_tx_appended() {
+        if(complete_tx_pending && --complete_tx_pending)
+            limit_buffered(complete_tx_block, complete_tx_time, complete_tx_block);
+        else if(complete_tx_block->size() > policy.block_size)
+            flush_block(complete_tx_block);
+        else
+            limit_buffered(complete_tx_block, complete_tx_time);
+    }
+    /**
+     * accounts the growth of block and writes the oldest blocks while the buffered data exceeds the memory budget or
+     * they were opened more than max_age before time. Entries of blocks flushed in the meantime are skipped. The busy
+     * block holds an incomplete transaction, the oldest blocks are written up to it.
+     */
+    inline void limit_buffered(tx_block* block, uint64_t time, tx_block const* busy = nullptr) {
+        if(!policy.memory_budget && !policy.max_age)
+            return;
+        buffered += block->size() - block->accounted;
+        block->accounted = block->size();
+        while(open_blocks.size()) {
+            auto const& oldest = open_blocks.front();
+            if(oldest.generation == oldest.block->generation) {
+                auto over_budget = policy.memory_budget && buffered > policy.memory_budget;
+                auto too_old = policy.max_age && time > oldest.time + policy.max_age;
+                if((!over_budget && !too_old) || oldest.block == busy)
+                    break;
+                flush_block(oldest.block);
+            }
+            open_blocks.pop_front();
+        }
+    }
+
+    // names of begin and end attributes are fixed by the generator and the index so their keys are looked up only once
+    template <typename N> inline size_t get_name_key(uint64_t generator, event_type event, unsigned idx, N const& name) {
+        if(event == event_type::RECORD || idx == no_index || generator >= generator_attr_names.size())
+            return dict.get_key(name);
+        auto& keys = generator_attr_names[generator][event == event_type::BEGIN ? 0 : 1];
+        if(idx < keys.size() && keys[idx] != std::numeric_limits<size_t>::max())
+            return keys[idx];
+        if(idx >= keys.size())
+            keys.resize(idx + 1, std::numeric_limits<size_t>::max());
+        return keys[idx] = dict.get_key(name);
+    }
+    /**
+     * returns the dictionary key of a string value or dictionary::npos if it is to be written inline. Once the values of
+     * an attribute name added max_distinct_strings strings to the dictionary only strings already known get a key.
+     * Older readers expect dictionary keys only so PLAIN blocks never write strings inline.
+     */
+    inline size_t get_value_key(size_t name_key, nonstd::string_view const& value) {
+        if(!policy.max_distinct_strings || policy.format == block_format::PLAIN)
+            return dict.get_key(value);
+        if(name_key >= distinct_strings.size())
+            distinct_strings.resize(name_key + 1);
+        auto& count = distinct_strings[name_key];
+        if(count >= policy.max_distinct_strings)
+            return dict.find_key(value);
+        auto size = dict.size();
+        auto key = dict.get_key(value);
+        count += dict.size() != size;
+        return key;
+    }
 };
 } // namespace ftr
 #endif /* FTR_FTR_WRITER_H */
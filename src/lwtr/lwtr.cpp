@@ -16,34 +16,96 @@
 
 #include "lwtr.h"
 
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 
 namespace lwtr {
+namespace {
+// selects the thread aware variants of id allocation, handle pools and backends, see tx_db::set_thread_safe()
+bool thread_safe{false};
+// the thread which enabled thread-safe mode, it is taken to be the SystemC kernel thread
+std::thread::id kernel_thread;
+// the SystemC kernel is not thread-safe so it is neither queried nor used for reports from other threads
+bool on_kernel_thread() { return !thread_safe || std::this_thread::get_id() == kernel_thread; }
+} // namespace
 ///////////////////////////////////////////////////////////////////////////////
 /// tx_db
 ///////////////////////////////////////////////////////////////////////////////
 
+namespace {
+// relation names are interned process wide so a handle means the same relation in every database
+struct relation_registry {
+    std::mutex mtx;
+    std::unordered_map<std::string, tx_relation_handle> by_name;
+    std::deque<std::string> names{""};
+
+    tx_relation_handle intern(const char* relation_name) {
+        std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+        if(thread_safe)
+            lock.lock();
+        auto& handle = by_name[relation_name];
+        if(handle == 0) {
+            handle = names.size();
+            names.emplace_back(relation_name);
+        }
+        return handle;
+    }
+
+    std::string const& name(tx_relation_handle handle) {
+        std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+        if(thread_safe)
+            lock.lock();
+        return handle < names.size() ? names[handle] : names[0];
+    }
+    // never destroyed as relations might be created and used by objects with static storage duration
+    static relation_registry& get() {
+        static auto* registry = new relation_registry();
+        return *registry;
+    }
+};
+} // namespace
+
+tx_relation::tx_relation(const char* relation_name)
+: handle(relation_registry::get().intern(relation_name)) {}
+
 struct tx_db::impl {
     const std::string file_name;
-    tx_relation_handle relation_handle_counter{0};
-    std::unordered_map<tx_relation_handle, std::string> relation_by_handle_map;
-    std::unordered_map<std::string, tx_relation_handle> relation_by_name_map;
+    const sc_core::sc_time_unit time_unit;
+    std::vector<std::unique_ptr<tx_backend>> backends;
 
-    impl(std::string s)
-    : file_name(std::move(s)) {}
+    impl(std::string s, sc_core::sc_time_unit time_unit)
+    : file_name(std::move(s))
+    , time_unit(time_unit) {}
 
     static tx_db* default_db;
     static std::vector<std::pair<uint64_t, tx_db_class_cb>> cb;
     using cb_entry = std::vector<std::pair<uint64_t, tx_db_class_cb>>::value_type;
+    static std::vector<std::pair<uint64_t, tx_backend_factory>> bf;
+    using bf_entry = std::vector<std::pair<uint64_t, tx_backend_factory>>::value_type;
 };
 tx_db* tx_db::impl::default_db = nullptr;
 std::vector<std::pair<uint64_t, tx_db::tx_db_class_cb>> tx_db::impl::cb;
+std::vector<std::pair<uint64_t, tx_db::tx_backend_factory>> tx_db::impl::bf;
 
-tx_db::tx_db(std::string const& recording_file_name, sc_core::sc_time_unit)
-: pimpl(new tx_db::impl(recording_file_name)) {
+tx_db::tx_db(std::string const& recording_file_name, sc_core::sc_time_unit time_unit)
+: pimpl(new tx_db::impl(recording_file_name, time_unit)) {
     impl::default_db = this;
+#ifndef LWTR_DISABLE
+    for(auto& e : impl::bf)
+        if(auto backend = e.second(*this)) {
+            if(pimpl->backends.size() == tx_backend::max_backends) {
+                SC_REPORT_WARNING("tx_db::tx_db", "too many backends registered, ignoring the remaining ones");
+                break;
+            }
+            backend->slot = pimpl->backends.size();
+            pimpl->backends.emplace_back(std::move(backend));
+        }
+#endif
     for(auto& e : impl::cb)
         e.second(*this, CREATE);
 }
@@ -69,26 +131,155 @@ void tx_db::unregister_class_cb(uint64_t id) {
         impl::cb.erase(it);
 }
 
-std::string const& tx_db::get_name() const { return pimpl->file_name; }
+uint64_t tx_db::register_backend(tx_backend_factory bf) {
+    auto index = impl::bf.size() ? impl::bf.back().first + 1 : 0;
+    impl::bf.emplace_back(index, bf);
+    return index;
+}
 
-tx_relation_handle tx_db::create_relation(const char* relation_name) const {
-    auto& tmp_handle = pimpl->relation_by_name_map[relation_name];
-    if(tmp_handle == 0) {
-        tmp_handle = ++pimpl->relation_handle_counter;
-        pimpl->relation_by_handle_map[tmp_handle] = relation_name;
-    }
-    return tmp_handle;
+void tx_db::unregister_backend(uint64_t id) {
+    auto it = std::find_if(std::begin(impl::bf), std::end(impl::bf), [id](impl::bf_entry const& e) { return e.first == id; });
+    if(it != std::end(impl::bf))
+        impl::bf.erase(it);
 }
 
+void tx_db::set_thread_safe(bool en) {
+    thread_safe = en;
+    kernel_thread = std::this_thread::get_id();
+}
+
+bool tx_db::is_thread_safe() { return thread_safe; }
+
+std::string const& tx_db::get_name() const { return pimpl->file_name; }
+
+sc_core::sc_time_unit tx_db::get_time_unit() const { return pimpl->time_unit; }
+
+tx_relation_handle tx_db::create_relation(const char* relation_name) const { return relation_registry::get().intern(relation_name); }
+
 std::string const& tx_db::get_relation_name(tx_relation_handle relation_handle) const {
-    return pimpl->relation_by_handle_map[relation_handle];
+    return relation_registry::get().name(relation_handle);
 }
 ///////////////////////////////////////////////////////////////////////////////
 /// tx_fiber
 ///////////////////////////////////////////////////////////////////////////////
 namespace {
-uint64_t fid_counter{0};
-uint64_t tid_counter{0};
+std::atomic<uint64_t> fid_counter{0};
+std::atomic<uint64_t> tid_counter{0};
+// number of transaction ids a thread reserves at once in thread-safe mode
+constexpr uint64_t tid_block_size = 1024;
+
+uint64_t next_tx_id() {
+    if(!thread_safe) {
+        // single writer, so no atomic read-modify-write is needed
+        auto id = tid_counter.load(std::memory_order_relaxed) + 1;
+        tid_counter.store(id, std::memory_order_relaxed);
+        return id;
+    }
+    thread_local uint64_t next_id{0}, end_id{0};
+    if(next_id == end_id) {
+        next_id = tid_counter.fetch_add(tid_block_size) + 1;
+        end_id = next_id + tid_block_size;
+    }
+    return next_id++;
+}
+/**
+ * free list based slab allocator handing out storage for objects of type T. Slabs are never returned to the heap
+ * so in steady state allocation and deallocation are just pointer operations on the free list.
+ * In thread-safe mode each thread owns a pool. Storage freed by another thread is pushed onto the remote free list
+ * of the pool it came from, which the owner takes over once its own free list runs empty. The pool of an exiting
+ * thread is parked and handed to the next thread needing one, so its slabs are reused rather than leaked.
+ */
+template <typename T, size_t SLAB_SIZE = 1024> class slab_pool {
+    struct node {
+        union {
+            node* next;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        };
+        slab_pool* owner;
+    };
+    std::vector<std::unique_ptr<node[]>> slabs;
+    node* free_list{nullptr};
+    std::atomic<node*> remote_free{nullptr};
+
+    void grow() {
+        slabs.emplace_back(new node[SLAB_SIZE]);
+        auto* slab = slabs.back().get();
+        for(auto i = SLAB_SIZE; i > 0; --i) {
+            slab[i - 1].owner = this;
+            slab[i - 1].next = free_list;
+            free_list = &slab[i - 1];
+        }
+    }
+    // only ever emptied as a whole by exchange() so the push cannot suffer from ABA
+    void push_remote(node* n) {
+        auto* head = remote_free.load(std::memory_order_relaxed);
+        do
+            n->next = head;
+        while(!remote_free.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_relaxed));
+    }
+    // pools of exited threads
+    struct parking {
+        std::mutex mtx;
+        std::vector<slab_pool*> pools;
+    };
+    static parking& parked() {
+        static auto* p = new parking();
+        return *p;
+    }
+    // the pool owned by the calling thread, nullptr if it has none
+    static slab_pool*& thread_pool() {
+        thread_local slab_pool* pool{nullptr};
+        return pool;
+    }
+    // adopts a parked pool or creates one for the calling thread and parks it again when the thread exits
+    struct thread_owner {
+        thread_owner() {
+            auto& p = parked();
+            std::lock_guard<std::mutex> lock(p.mtx);
+            if(p.pools.size()) {
+                thread_pool() = p.pools.back();
+                p.pools.pop_back();
+            } else
+                thread_pool() = new slab_pool();
+        }
+        ~thread_owner() {
+            auto& p = parked();
+            std::lock_guard<std::mutex> lock(p.mtx);
+            p.pools.push_back(thread_pool());
+            thread_pool() = nullptr;
+        }
+    };
+
+public:
+    void* allocate() {
+        if(!free_list)
+            free_list = remote_free.exchange(nullptr, std::memory_order_acquire);
+        if(!free_list)
+            grow();
+        auto* n = free_list;
+        free_list = n->next;
+        return &n->storage;
+    }
+    // returns the storage to the pool it was allocated from
+    static void deallocate(void* p) {
+        auto* n = static_cast<node*>(p);
+        auto* owner = n->owner;
+        if(!thread_safe || owner == thread_pool()) {
+            n->next = owner->free_list;
+            owner->free_list = n;
+        } else
+            owner->push_remote(n);
+    }
+    // the pools are intentionally never destroyed as handles might live in objects with static storage duration or
+    // outlive the thread which allocated them
+    static slab_pool& get() {
+        static auto* pool = new slab_pool();
+        if(!thread_safe)
+            return *pool;
+        thread_local thread_owner owner;
+        return *thread_pool();
+    }
+};
 } // namespace
 struct tx_fiber::impl {
     static std::vector<std::pair<uint64_t, tx_fiber_class_cb>> cb;
@@ -102,6 +293,9 @@ tx_fiber::tx_fiber(const char* fiber_name, const char* fiber_kind, tx_db* tx_db_
 , fiber_kind(fiber_kind)
 , db(tx_db_p)
 , id(++fid_counter) {
+    if(db)
+        for(auto& b : db->pimpl->backends)
+            b->create_fiber(*this);
     for(auto& e : impl::cb)
         e.second(*this, CREATE);
 }
@@ -138,6 +332,9 @@ tx_generator_base::tx_generator_base(std::string name, tx_fiber& fiber, std::str
 , begin_attr_name(std::move(begin_attribute_name))
 , end_attr_name(std::move(end_attribute_name))
 , id(++fid_counter) {
+    if(auto db = fiber.get_tx_db())
+        for(auto& b : db->pimpl->backends)
+            b->create_generator(*this);
     for(auto& e : impl::cb)
         e.second(*this, CREATE);
     if(with_events) {
@@ -164,36 +361,69 @@ void tx_generator_base::unregister_class_cb(uint64_t id) {
         impl::cb.erase(it);
 }
 
-tx_handle tx_generator_base::begin_tx(value const& v, sc_core::sc_time const& begin_time, tx_relation_handle relation_handle,
-                                      const tx_handle* other_handle_p) const {
-    tx_handle hndl(*this, v, begin_time);
-    if(other_handle_p)
-        hndl.add_relation(relation_handle, *other_handle_p);
-    return hndl;
+void tx_generator_base::record_batch(tx_batch& batch) const {
+    static tx_relation const parent_of("parent_of");
+    batch.parent_relation = parent_of;
+    for(auto& e : batch.txs) {
+        if(on_kernel_thread() && e.begin_time < sc_core::sc_time_stamp()) {
+            std::stringstream ss;
+            ss << "transaction start time (" << e.begin_time << ") needs to be larger than current time (" << sc_core::sc_time_stamp()
+               << ")";
+            SC_REPORT_ERROR("tx_generator_base::record_txs", ss.str().c_str());
+        }
+        // like tx_handle::set_end_time() a transaction never ends before it started
+        if(e.end_time < e.begin_time)
+            e.end_time = e.begin_time;
+        e.id = next_tx_id();
+        if(e.parent && !e.parent->is_valid())
+            e.parent = nullptr;
+    }
+    for(auto& b : fiber.get_tx_db()->pimpl->backends)
+        b->record_txs(*this, batch);
 }
 
-void tx_generator_base::end_tx(tx_handle& t, value const& v, sc_core::sc_time const& end_time) const { t.deactivate(v, end_time); }
 ///////////////////////////////////////////////////////////////////////////////
 /// tx_handle
 ///////////////////////////////////////////////////////////////////////////////
 struct tx_handle::impl {
     tx_generator_base const& gen;
     uint64_t id{std::numeric_limits<uint64_t>::max()};
+    // the backends of the database if it was recording when the transaction started
+    std::vector<std::unique_ptr<tx_backend>> const* backends{nullptr};
+    std::array<void*, tx_backend::max_backends> backend_data{};
+    // copies of a handle may be released by other threads in thread-safe mode
+    std::atomic<unsigned> ref_count{1};
     bool active{false};
     sc_core::sc_time begin_time, end_time;
 
     impl(tx_generator_base const& gen, sc_core::sc_time const& t)
     : gen(gen)
-    , id(++tid_counter)
+    , id(next_tx_id())
     , active{true}
     , begin_time(t) {
-        if(t < sc_core::sc_time_stamp()) {
+        if(on_kernel_thread() && t < sc_core::sc_time_stamp()) {
             std::stringstream ss;
             ss << "transaction start time (" << t << ") needs to be larger than current time (" << sc_core::sc_time_stamp() << ")";
             SC_REPORT_ERROR("tx_handle::tx_handle", ss.str().c_str());
         }
     }
 
+    void add_ref() {
+        if(thread_safe)
+            ref_count.fetch_add(1, std::memory_order_relaxed);
+        else
+            ref_count.store(ref_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    // returns true if the last reference was dropped
+    bool drop_ref() {
+        if(thread_safe)
+            return ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        auto count = ref_count.load(std::memory_order_relaxed) - 1;
+        ref_count.store(count, std::memory_order_relaxed);
+        return count == 0;
+    }
+
+    using pool = slab_pool<impl>;
     static std::vector<std::pair<uint64_t, tx_handle_class_cb>> cb;
     using cb_entry = std::vector<std::pair<uint64_t, tx_handle_class_cb>>::value_type;
     static std::vector<std::pair<uint64_t, tx_handle_attribute_cb>> acb;
@@ -205,24 +435,74 @@ std::vector<std::pair<uint64_t, tx_handle::tx_handle_class_cb>> tx_handle::impl:
 std::vector<std::pair<uint64_t, tx_handle::tx_handle_attribute_cb>> tx_handle::impl::acb;
 std::vector<std::pair<uint64_t, tx_handle::tx_handle_relation_cb>> tx_handle::impl::rcb;
 
-tx_handle::tx_handle(tx_generator_base const& gen, value const& v, sc_core::sc_time const& t)
-: pimpl(std::make_shared<impl>(gen, t)) {
-    for(auto& e : impl::cb)
-        e.second(*this, BEGIN, v);
+tx_handle::tx_handle(tx_generator_base const& gen, sc_core::sc_time const& t)
+: pimpl(new(impl::pool::get().allocate()) impl(gen, t)) {
+    // the generator checked that the database exists and is recording
+    auto& backends = gen.get_tx_fiber().get_tx_db()->pimpl->backends;
+    if(backends.size()) {
+        pimpl->backends = &backends;
+        for(auto& b : *pimpl->backends)
+            b->begin_tx(*this);
+    }
+}
+
+tx_handle::tx_handle(tx_handle const& o)
+: pimpl(o.pimpl) {
+    if(pimpl)
+        pimpl->add_ref();
+}
+
+tx_handle& tx_handle::operator=(tx_handle const& o) {
+    if(o.pimpl)
+        o.pimpl->add_ref();
+    if(pimpl)
+        release();
+    pimpl = o.pimpl;
+    return *this;
+}
+
+void tx_handle::release() {
+    if(pimpl->drop_ref()) {
+        pimpl->~impl();
+        impl::pool::deallocate(pimpl);
+    }
+    pimpl = nullptr;
 }
 
-void tx_handle::deactivate(value const& v, sc_core::sc_time const& t) {
-    if(t < sc_core::sc_time_stamp()) {
+std::vector<std::unique_ptr<tx_backend>> const* tx_handle::get_backends() const { return pimpl->backends; }
+
+void tx_handle::set_end_time(sc_core::sc_time const& t) {
+    if(on_kernel_thread() && t < sc_core::sc_time_stamp()) {
         std::stringstream ss;
         ss << "transaction end time (" << t << ") needs to be larger than current time (" << sc_core::sc_time_stamp() << ")";
         SC_REPORT_ERROR("tx_handle::deactivate", ss.str().c_str());
     }
     pimpl->end_time = pimpl->begin_time <= t ? t : pimpl->begin_time;
-    for(auto& e : impl::cb)
-        e.second(*this, END, v);
+}
+
+void tx_handle::close() {
+    if(pimpl->backends)
+        for(auto& b : *pimpl->backends)
+            b->end_tx(*this);
     pimpl->active = false;
 }
 
+void tx_handle::notify(callback_reason reason, value const& v) const {
+    for(auto& e : impl::cb)
+        e.second(*this, reason, v);
+}
+
+void tx_handle::notify_record_attribute(char const* name, value const& v) const {
+    for(auto& e : impl::acb)
+        e.second(*this, name, v);
+}
+
+bool tx_handle::has_class_cb() { return impl::cb.size(); }
+
+bool tx_handle::has_record_attribute_cb() { return impl::acb.size(); }
+
+bool tx_handle::has_relation_cb() { return impl::rcb.size(); }
+
 uint64_t tx_handle::register_class_cb(tx_handle_class_cb cb) {
     auto index = impl::cb.size() ? impl::cb.back().first + 1 : 0;
     impl::cb.emplace_back(index, cb);
@@ -259,26 +539,35 @@ void tx_handle::unregister_relation_cb(uint64_t id) {
         impl::rcb.erase(it);
 }
 
-bool tx_handle::is_active() const { return pimpl->active; }
+bool tx_handle::is_active() const { return pimpl && pimpl->active; }
+
+uint64_t tx_handle::get_id() const { return pimpl ? pimpl->id : std::numeric_limits<uint64_t>::max(); }
 
-uint64_t tx_handle::get_id() const { return pimpl->id; }
+void* tx_handle::get_backend_data(unsigned slot) const { return pimpl->backend_data[slot]; }
 
-void tx_handle::end_tx(const value& v, sc_core::sc_time const& end_sc_time) { pimpl->gen.end_tx(*this, v, end_sc_time); }
+void tx_handle::set_backend_data(unsigned slot, void* data) const { pimpl->backend_data[slot] = data; }
 
-sc_core::sc_time tx_handle::get_begin_sc_time() const { return pimpl->begin_time; }
+sc_core::sc_time tx_handle::get_begin_sc_time() const { return pimpl ? pimpl->begin_time : sc_core::SC_ZERO_TIME; }
 
-sc_core::sc_time tx_handle::get_end_sc_time() const { return pimpl->end_time; }
+sc_core::sc_time tx_handle::get_end_sc_time() const { return pimpl ? pimpl->end_time : sc_core::SC_ZERO_TIME; }
 
 tx_fiber const& tx_handle::get_tx_fiber() const { return pimpl->gen.get_tx_fiber(); }
 
 tx_generator_base const& tx_handle::get_tx_generator_base() const { return pimpl->gen; }
 
 void tx_handle::record_attribute(const char* name, value const& v) {
-    for(auto& e : impl::acb)
-        e.second(*this, name, v);
+    if(!is_valid())
+        return;
+    stream_attribute(event_type::RECORD, name, v);
+    notify_record_attribute(name, v);
 }
 
 bool tx_handle::add_relation(tx_relation_handle relation_handle, tx_handle const& other_transaction_handle) {
+    if(!is_valid() || !other_transaction_handle.is_valid())
+        return false;
+    if(pimpl->backends)
+        for(auto& b : *pimpl->backends)
+            b->add_relation(*this, other_transaction_handle, relation_handle);
     for(auto& e : impl::rcb)
         e.second(*this, other_transaction_handle, relation_handle);
     return true;
@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -65,11 +69,11 @@ public:
 };
 
 template <typename T> struct key_value {
-    std::string key;
+    nonstd::string_view key;
     T const& value;
 };
 
-template <typename T> key_value<T> field(std::string const& k, T const& v) { return {k, v}; }
+template <typename T> key_value<T> field(nonstd::string_view k, T const& v) { return {k, v}; }
 
 template <typename T> value record(T const& t);
 template <typename T> value record(T& t);
@@ -86,16 +90,20 @@ public:
     ~access() = default;
 
     template <typename T> access& operator&(key_value<T> const& kv) {
-        o.emplace_back(std::make_pair(kv.key, record(kv.value)));
+        o.emplace_back(std::make_pair(nonstd::to_string(kv.key), record(kv.value)));
         return *this;
     }
     inline value get_value() const { return value(o); }
 };
 
 template <typename T, class Enable = void> struct value_converter {
+    using compound = std::true_type;
+
+    template <typename Archive> static void serialize(Archive& a, T const& v) { record(a, v); }
+
     static value to_value(T const& v) {
         access a;
-        record(a, v);
+        serialize(a, v);
         return a.get_value();
     }
 
@@ -111,9 +119,13 @@ template <typename T> struct value_converter<T, typename std::enable_if<std::is_
 };
 
 template <typename T> struct value_converter<T, typename std::enable_if<has_record_member<T>::value>::type> {
+    using compound = std::true_type;
+
+    template <typename Archive> static void serialize(Archive& a, T const& v) { v.record(a); }
+
     static value to_value(T const& v) {
         access a;
-        v.record(a);
+        serialize(a, v);
         return a.get_value();
     }
 
@@ -126,6 +138,9 @@ template <typename T> struct value_converter<T, typename std::enable_if<has_reco
 template <> struct value_converter<no_data> {
     static value to_value(no_data v) { return value(); }
 };
+template <> struct value_converter<value> {
+    static value const& to_value(value const& v) { return v; }
+};
 /// standard types
 #define VAL_CONV(T)                                                                                                                        \
     template <> struct value_converter<T> {                                                                                                \
@@ -192,18 +207,279 @@ template <int W, int I, sc_dt::sc_q_mode Q, sc_dt::sc_o_mode O, int N> struct va
     static value to_value(sc_dt::sc_ufixed_fast<W, I, Q, O, N> const& v) { return value(v.to_double()); }
 };
 #endif
+/// types recorded as objects (using a record() member or free function) are streamed field by field
+template <typename T, class Enable = void> struct is_compound : std::false_type {};
+template <typename T>
+struct is_compound<T, typename std::conditional<true, void, typename value_converter<T>::compound>::type> : std::true_type {};
 
 using tx_relation_handle = uint64_t;
+/**
+ * relation type interned once in a process wide registry, typically held in a static object. It converts to its
+ * tx_relation_handle which is valid in every tx_db so recording relations with it does not involve any string
+ * operations and backends can cache the data they derive from the name per handle.
+ */
+class tx_relation {
+    tx_relation_handle handle;
+
+public:
+    explicit tx_relation(const char* relation_name);
+
+    explicit tx_relation(std::string const& relation_name)
+    : tx_relation(relation_name.c_str()) {}
+
+    operator tx_relation_handle() const { return handle; }
+};
 enum callback_reason { CREATE, DELETE, SUSPEND, RESUME, BEGIN, END };
+class tx_db;
+class tx_fiber;
 class tx_handle;
 class tx_generator_base;
+enum class event_type { BEGIN, RECORD, END };
+/**
+ * complete transactions of a generator collected by tx_generator::record_txs() and handed to the backends in a single
+ * call. The leaves of the begin and end attributes of a transaction are stored consecutively in attributes.
+ */
+struct tx_batch {
+    struct attribute {
+        event_type event;
+        unsigned index;
+        nonstd::string_view name;
+        value v;
+    };
+    struct entry {
+        uint64_t id;
+        sc_core::sc_time begin_time, end_time;
+        tx_handle const* parent;
+        size_t first_attribute, attribute_count;
+    };
+    std::vector<entry> txs;
+    std::vector<attribute> attributes;
+    tx_relation_handle parent_relation{0};
+
+    void add_attribute(event_type event, unsigned index, nonstd::string_view const& name, value const& v) {
+        // consecutive transactions of a generator usually have identical attribute names so the previous one is reused
+        auto& tx = txs.back();
+        nonstd::string_view stored_name;
+        if(txs.size() > 1) {
+            auto& prev = txs[txs.size() - 2];
+            if(tx.attribute_count < prev.attribute_count && attributes[prev.first_attribute + tx.attribute_count].name == name)
+                stored_name = attributes[prev.first_attribute + tx.attribute_count].name;
+        }
+        if(stored_name.empty()) {
+            names.emplace_back(name.data(), name.size());
+            stored_name = names.back();
+        }
+        attributes.push_back(attribute{event, index, stored_name, v});
+        ++tx.attribute_count;
+    }
+
+private:
+    std::deque<std::string> names;
+};
+/**
+ * interface of a recording backend. An instance is created per tx_db by the factories registered with
+ * tx_db::register_backend. The frontend checks the database and its recording state once, so the
+ * backend receives exactly one virtual call per event and does not need to re-validate.
+ */
+class tx_backend {
+    friend class tx_db;
+    unsigned slot{0};
+
+public:
+    /// number of backends per database, each of them owns a slot of opaque data in every transaction
+    static constexpr unsigned max_backends = 4;
+    /// index of begin and end attributes whose names are not determined by the generator, e.g. fields of a value
+    static constexpr unsigned no_index = std::numeric_limits<unsigned>::max();
+
+    virtual ~tx_backend() = default;
+    /// index of the per transaction data of this backend, see tx_handle::get_backend_data()
+    unsigned get_slot() const { return slot; }
+
+    virtual void create_fiber(tx_fiber const&) = 0;
+
+    virtual void create_generator(tx_generator_base const&) = 0;
+
+    virtual void begin_tx(tx_handle const&) = 0;
+    /**
+     * receives a single attribute (never an object) with its fully qualified name. The index is the position of the
+     * attribute within the recorded value. For begin and end attributes the name is determined by the generator and
+     * the index unless it is no_index, so backends may cache name related data per generator and index.
+     */
+    virtual void record_attribute(tx_handle const&, event_type, unsigned, nonstd::string_view const&, value const&) = 0;
+
+    virtual void end_tx(tx_handle const&) = 0;
+
+    virtual void add_relation(tx_handle const&, tx_handle const&, tx_relation_handle) = 0;
+    /// records complete transactions having valid ids, parents are related using the relation of the batch
+    virtual void record_txs(tx_generator_base const&, tx_batch const&) = 0;
+};
+/**
+ * names of the begin or end attributes of a generator. The first record captures them and later records reuse them
+ * instead of composing the names again unless the attribute contains a value, its fields may differ between records.
+ * Serializers therefore need to write the same fields every time.
+ */
+struct attribute_names {
+    enum { UNKNOWN, CAPTURING, FIXED, VARIABLE };
+    std::atomic<int> state{UNKNOWN};
+    std::vector<std::string> names;
+};
+/**
+ * archive streaming the fields of an attribute directly into the backends of a transaction or into a tx_batch. Objects
+ * are flattened into hierarchical names while being traversed so no intermediate value tree is built.
+ */
+class stream_access {
+    using backend_list = std::vector<std::unique_ptr<tx_backend>>;
+    backend_list const* const backends{nullptr};
+    tx_handle const* const hndl{nullptr};
+    tx_batch* const batch{nullptr};
+    event_type const event;
+    attribute_names* const cache{nullptr};
+    std::array<char, 1024> name;
+    // names exceeding name move to long_name
+    std::string long_name;
+    char* buf{name.data()};
+    size_t capacity{name.size()};
+    size_t name_len{0};
+    unsigned index{0};
+    // the names are taken from cache or are captured into it
+    bool use_cache{false};
+    bool capture{false};
+    // set once a value was written, the names of the following attributes are not fixed
+    bool variable{false};
+    std::vector<std::string> captured;
+
+public:
+    stream_access(backend_list const& backends, tx_handle const& hndl, event_type event, nonstd::string_view const& root,
+                  attribute_names* cache = nullptr)
+    : backends(&backends)
+    , hndl(&hndl)
+    , event(event)
+    , cache(cache) {
+        init(root);
+    }
+
+    stream_access(tx_batch& batch, event_type event, nonstd::string_view const& root, attribute_names* cache = nullptr)
+    : batch(&batch)
+    , event(event)
+    , cache(cache) {
+        init(root);
+    }
+    stream_access(stream_access const& o) = delete;
+    stream_access(stream_access&& o) = delete;
+    stream_access& operator=(stream_access const& o) = delete;
+    stream_access& operator=(stream_access&& o) = delete;
+    // a capture interrupted by an exception is retried by the next record
+    ~stream_access() {
+        if(capture)
+            cache->state.store(attribute_names::UNKNOWN, std::memory_order_release);
+    }
+    /// writes the complete attribute and publishes the names if this record captured them
+    template <typename T> void write_attribute(T const& v) {
+        write(v);
+        if(capture) {
+            if(!variable)
+                cache->names = std::move(captured);
+            cache->state.store(variable ? attribute_names::VARIABLE : attribute_names::FIXED, std::memory_order_release);
+            capture = false;
+        }
+    }
+
+    template <typename T> stream_access& operator&(key_value<T> const& kv) {
+        auto old_len = name_len;
+        append_name(kv.key);
+        write(kv.value);
+        name_len = old_len;
+        return *this;
+    }
+
+    template <typename T> typename std::enable_if<is_compound<T>::value>::type write(T const& v) {
+        value_converter<T>::serialize(*this, v);
+    }
+
+    template <typename T> typename std::enable_if<!is_compound<T>::value>::type write(T const& v) {
+        emit(value_converter<T>::to_value(v));
+    }
+
+    void write(std::string const& v) { emit(value(v.c_str())); }
+
+    void write(value const& v) {
+        variable = true;
+        if(v.index() != 10) {
+            emit(v);
+            return;
+        }
+        for(auto& e : nonstd::get<10>(v)) {
+            auto old_len = name_len;
+            append_name(e.first);
+            write(e.second);
+            name_len = old_len;
+        }
+    }
+
+private:
+    void init(nonstd::string_view const& root) {
+        if(cache) {
+            auto state = cache->state.load(std::memory_order_acquire);
+            use_cache = state == attribute_names::FIXED;
+            if(state == attribute_names::UNKNOWN)
+                capture = cache->state.compare_exchange_strong(state, attribute_names::CAPTURING, std::memory_order_acquire);
+        }
+        append_name(root);
+    }
+
+    void append_name(nonstd::string_view const& n) {
+        if(!n.length() || use_cache)
+            return;
+        auto len = name_len + (name_len ? 1 : 0) + n.length();
+        if(len >= capacity)
+            grow(len + 1);
+        if(name_len)
+            buf[name_len++] = '.';
+        std::memcpy(buf + name_len, n.data(), n.length());
+        name_len += n.length();
+    }
+    // long names move to the heap instead of being truncated
+    void grow(size_t size) {
+        if(long_name.empty())
+            long_name.assign(name.data(), name_len);
+        long_name.resize(2 * size);
+        buf = &long_name[0];
+        capacity = long_name.size();
+    }
+
+    void emit(value const& v) {
+        if(v.index() == 0) // no data
+            return;
+        nonstd::string_view n;
+        if(use_cache)
+            n = index < cache->names.size() ? nonstd::string_view(cache->names[index]) : nonstd::string_view("unnamed");
+        else {
+            buf[name_len] = 0;
+            n = name_len ? nonstd::string_view(buf, name_len) : nonstd::string_view("unnamed");
+            if(capture && !variable)
+                captured.emplace_back(n.data(), n.size());
+        }
+        auto const idx = variable ? tx_backend::no_index : index;
+        if(batch)
+            batch->add_attribute(event, idx, n, v);
+        else
+            for(auto& b : *backends)
+                b->record_attribute(*hndl, event, idx, n, v);
+        ++index;
+    }
+};
 
 class tx_db {
     struct impl;
     std::unique_ptr<impl> pimpl;
     bool enable{true};
+    friend class tx_fiber;
+    friend class tx_generator_base;
+    friend class tx_handle;
 
 public:
+    /// the time unit sets the granularity of the time stamps written by the backends, units finer than the kernel
+    /// resolution record in the kernel resolution
     tx_db(std::string const& recording_file_name, sc_core::sc_time_unit = sc_core::SC_FS);
 
     virtual ~tx_db();
@@ -216,9 +492,28 @@ public:
     static uint64_t register_class_cb(tx_db_class_cb);
 
     static void unregister_class_cb(uint64_t);
+    /// a factory returns the backend for the given database or nullptr if it cannot record into it
+    using tx_backend_factory = std::function<std::unique_ptr<tx_backend>(tx_db const&)>;
+    static uint64_t register_backend(tx_backend_factory);
+
+    static void unregister_backend(uint64_t);
+    /**
+     * allows recording from threads other than the SystemC kernel thread (e.g. ISS worker threads). It needs to be
+     * set before any database is created and callbacks need to be registered beforehand. In this mode a transaction
+     * can be handed over to another thread, e.g. begun by one and ended by another, and copies of a tx_handle may
+     * be released by different threads, but one tx_handle object must not be used by several threads at the same
+     * time. The thread calling this function is taken to be the SystemC kernel thread, only there times are checked
+     * against sc_time_stamp(). Worker threads should pass explicit times as sc_time_stamp() is only meaningful in the
+     * kernel thread.
+     */
+    static void set_thread_safe(bool);
+
+    static bool is_thread_safe();
 
     std::string const& get_name() const;
 
+    sc_core::sc_time_unit get_time_unit() const;
+
     void set_recording(bool en) { enable = en; }
 
     bool get_recording() const { return enable; }
@@ -260,6 +555,15 @@ public:
     tx_db const* get_tx_db() const { return db; }
 };
 
+/// a complete transaction recorded by tx_generator::record_txs(), parent is optional
+template <typename BEGIN = no_data, typename END = no_data> struct tx_record {
+    sc_core::sc_time begin_time;
+    sc_core::sc_time end_time;
+    BEGIN begin_attr;
+    END end_attr;
+    tx_handle const* parent;
+};
+
 class tx_generator_base {
     struct impl;
     std::unique_ptr<impl> pimpl;
@@ -270,6 +574,7 @@ class tx_generator_base {
     uint64_t const id;
     std::unique_ptr<tx_generator_base> evt_gen;
     tx_relation_handle evt_rel;
+    mutable std::array<attribute_names, 2> attr_names;
 
 public:
     tx_generator_base(std::string name, tx_fiber& s, std::string begin_attribute_name = "", std::string end_attribute_name = "",
@@ -291,52 +596,120 @@ public:
     uint64_t get_id() const { return id; }
 
     tx_fiber const& get_tx_fiber() const { return fiber; }
+    /// checked before any attribute conversion or handle allocation takes place
+    bool is_recording() const {
+#ifdef LWTR_DISABLE
+        return false;
+#else
+        return fiber.get_tx_db() && fiber.get_tx_db()->get_recording();
+#endif
+    }
 
 protected:
     friend class tx_handle;
-    tx_handle begin_tx(value const&, sc_core::sc_time const&, tx_relation_handle, tx_handle const* = nullptr) const;
-    void end_tx(tx_handle&, value const&, sc_core::sc_time const&) const;
+    template <typename T>
+    tx_handle begin_tx(T const&, sc_core::sc_time const&, tx_relation_handle, tx_handle const* = nullptr) const;
+    template <typename T> tx_handle begin_tx(T const&, sc_core::sc_time const&, const char*, tx_handle const&) const;
+    template <typename T> void end_tx(tx_handle&, T const&, sc_core::sc_time const&) const;
+    template <typename B, typename E> void record_txs(tx_record<B, E> const*, size_t) const;
+    void record_batch(tx_batch&) const;
     std::unique_ptr<tx_generator_base> const& get_evt_gen() const { return evt_gen; }
     tx_relation_handle get_evt_rel() const { return evt_rel; }
+    attribute_names* get_attribute_names(event_type event) const {
+        return event == event_type::RECORD ? nullptr : &attr_names[event == event_type::BEGIN ? 0 : 1];
+    }
 };
 
 class tx_handle {
     struct impl;
-    std::shared_ptr<impl> pimpl;
+    impl* pimpl{nullptr};
     friend class tx_generator_base;
-    tx_handle(const tx_generator_base& gen, value const& v, sc_core::sc_time const& t);
-    void deactivate(value const& v, sc_core::sc_time const& t);
-    void end_tx(const value& v, sc_core::sc_time const& end_sc_time);
+    tx_handle(const tx_generator_base& gen, sc_core::sc_time const& t);
+    template <typename T> void deactivate(T const& v, sc_core::sc_time const& t);
+    template <typename T> void end_tx(T const& v, sc_core::sc_time const& end_sc_time) {
+        if(is_valid())
+            get_tx_generator_base().end_tx(*this, v, end_sc_time);
+    }
+    template <typename T> void stream_attribute(event_type event, char const* name, T const& v) const {
+        if(auto backends = get_backends()) {
+            stream_access a(*backends, *this, event, name ? name : "", get_tx_generator_base().get_attribute_names(event));
+            a.write_attribute(v);
+        }
+    }
+    std::vector<std::unique_ptr<tx_backend>> const* get_backends() const;
+    void set_end_time(sc_core::sc_time const& t);
+    void close();
+    void notify(callback_reason reason, value const& v) const;
+    void notify_record_attribute(char const* name, value const& v) const;
+    static bool has_class_cb();
+    static bool has_record_attribute_cb();
+    static bool has_relation_cb();
+    void release();
 
 public:
-    tx_handle() {}
+    tx_handle() = default;
 
-    tx_handle(tx_handle const& o)
-    : pimpl(o.pimpl) {}
+    tx_handle(tx_handle const& o);
 
-    bool is_valid() const { return pimpl != nullptr; }
+    tx_handle(tx_handle&& o) noexcept
+    : pimpl(o.pimpl) {
+        o.pimpl = nullptr;
+    }
+
+    tx_handle& operator=(tx_handle const& o);
+
+    tx_handle& operator=(tx_handle&& o) noexcept {
+        if(this != &o) {
+            if(pimpl)
+                release();
+            pimpl = o.pimpl;
+            o.pimpl = nullptr;
+        }
+        return *this;
+    }
+
+    ~tx_handle() {
+        if(pimpl)
+            release();
+    }
+    /// handles returned while recording is disabled are invalid, all operations on them are no-ops
+    bool is_valid() const {
+#ifdef LWTR_DISABLE
+        return false;
+#else
+        return pimpl != nullptr;
+#endif
+    }
 
     bool is_active() const;
 
     uint64_t get_id() const;
+    /// opaque per transaction data of the backend owning the slot, it is nullptr when the transaction starts
+    void* get_backend_data(unsigned slot) const;
 
-    void end_tx() { end_tx(value(), sc_core::sc_time_stamp()); }
+    void set_backend_data(unsigned slot, void* data) const;
 
-    template <typename END> void end_tx(const END& attr) { end_tx(record(attr), sc_core::sc_time_stamp()); }
+    void end_tx() { end_tx(no_data(), sc_core::sc_time_stamp()); }
 
-    void end_tx_delayed(sc_core::sc_time const& end_time) { end_tx(value(), end_time); }
+    template <typename END> void end_tx(const END& attr) { end_tx(attr, sc_core::sc_time_stamp()); }
 
-    template <typename END> void end_tx_delayed(sc_core::sc_time const& end_time, const END& attr) {
-        end_tx(::lwtr::record(attr), end_time);
-    }
+    void end_tx_delayed(sc_core::sc_time const& end_time) { end_tx(no_data(), end_time); }
+
+    template <typename END> void end_tx_delayed(sc_core::sc_time const& end_time, const END& attr) { end_tx(attr, end_time); }
 
     void record_attribute(char const* name, value const& attr);
 
-    template <typename T> void record_attribute(std::string const& name, const T& attr) { record_attribute(name.c_str(), record(attr)); }
+    template <typename T> void record_attribute(std::string const& name, const T& attr) { record_attribute(name.c_str(), attr); }
 
-    template <typename T> void record_attribute(const char* name, const T& attr) { record_attribute(name, record(attr)); }
+    template <typename T> void record_attribute(const char* name, const T& attr) {
+        if(!is_valid())
+            return;
+        stream_attribute(event_type::RECORD, name, attr);
+        if(has_record_attribute_cb())
+            notify_record_attribute(name, record(attr));
+    }
 
-    template <typename T> void record_attribute(const T& attr) { record_attribute(nullptr, record(attr)); }
+    template <typename T> void record_attribute(const T& attr) { record_attribute(nullptr, attr); }
 
     using tx_handle_class_cb = std::function<void(const tx_handle&, callback_reason, value const&)>;
     static uint64_t register_class_cb(tx_handle_class_cb);
@@ -356,14 +729,16 @@ public:
     bool add_relation(tx_relation_handle, const tx_handle&);
 
     bool add_relation(const char* relation_name, const tx_handle& other_tx_h) {
-        return add_relation(get_tx_fiber().get_tx_db()->create_relation(relation_name), other_tx_h);
+        return is_valid() && add_relation(get_tx_fiber().get_tx_db()->create_relation(relation_name), other_tx_h);
     };
 
     bool add_relation(std::string const& relation_name, const tx_handle& other_tx_h) {
-        return add_relation(get_tx_fiber().get_tx_db()->create_relation(relation_name), other_tx_h);
+        return is_valid() && add_relation(get_tx_fiber().get_tx_db()->create_relation(relation_name), other_tx_h);
     };
 
     template <typename... NameValues> void record_event(const char* name, NameValues&&... nvs) {
+        if(!is_valid())
+            return;
         auto& evt_gen = get_tx_generator_base().get_evt_gen();
         if(evt_gen) {
             auto evt_hndl =
@@ -374,6 +749,8 @@ public:
     }
 
     template <typename... NameValues> void record_event_at_time(const char* name, sc_core::sc_time timestamp, NameValues&&... nvs) {
+        if(!is_valid())
+            return;
         auto& evt_gen = get_tx_generator_base().get_evt_gen();
         if(evt_gen) {
             auto evt_hndl = evt_gen->begin_tx(name ? value(name) : value(), timestamp, get_tx_generator_base().get_evt_rel(), this);
@@ -401,6 +778,63 @@ private:
     }
 };
 
+template <typename T> void tx_handle::deactivate(T const& v, sc_core::sc_time const& t) {
+    set_end_time(t);
+    stream_attribute(event_type::END, get_tx_generator_base().get_end_attribute_name().c_str(), v);
+    if(has_class_cb())
+        notify(END, record(v));
+    close();
+}
+
+template <typename T>
+tx_handle tx_generator_base::begin_tx(T const& v, sc_core::sc_time const& begin_time, tx_relation_handle relation_handle,
+                                      tx_handle const* other_handle_p) const {
+    if(!is_recording())
+        return tx_handle();
+    tx_handle hndl(*this, begin_time);
+    hndl.stream_attribute(event_type::BEGIN, begin_attr_name.c_str(), v);
+    if(tx_handle::has_class_cb())
+        hndl.notify(BEGIN, record(v));
+    if(other_handle_p)
+        hndl.add_relation(relation_handle, *other_handle_p);
+    return hndl;
+}
+
+template <typename T>
+tx_handle tx_generator_base::begin_tx(T const& v, sc_core::sc_time const& begin_time, const char* relation_name,
+                                      tx_handle const& other_handle) const {
+    if(!is_recording())
+        return tx_handle();
+    return begin_tx(v, begin_time, fiber.get_tx_db()->create_relation(relation_name), &other_handle);
+}
+
+template <typename T> void tx_generator_base::end_tx(tx_handle& t, T const& v, sc_core::sc_time const& end_time) const {
+    if(t.is_valid())
+        t.deactivate(v, end_time);
+}
+
+template <typename B, typename E> void tx_generator_base::record_txs(tx_record<B, E> const* txs, size_t count) const {
+    if(!is_recording() || !count)
+        return;
+    if(tx_handle::has_class_cb() || tx_handle::has_record_attribute_cb() || tx_handle::has_relation_cb()) {
+        // callbacks expect handles so the transactions take the regular path
+        auto relation = fiber.get_tx_db()->create_relation("parent_of");
+        for(size_t i = 0; i < count; ++i) {
+            auto hndl = begin_tx(txs[i].begin_attr, txs[i].begin_time, txs[i].parent ? relation : 0, txs[i].parent);
+            end_tx(hndl, txs[i].end_attr, txs[i].end_time);
+        }
+        return;
+    }
+    tx_batch batch;
+    batch.txs.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        batch.txs.push_back(tx_batch::entry{0, txs[i].begin_time, txs[i].end_time, txs[i].parent, batch.attributes.size(), 0});
+        stream_access(batch, event_type::BEGIN, begin_attr_name, get_attribute_names(event_type::BEGIN)).write_attribute(txs[i].begin_attr);
+        stream_access(batch, event_type::END, end_attr_name, get_attribute_names(event_type::END)).write_attribute(txs[i].end_attr);
+    }
+    record_batch(batch);
+}
+
 template <typename BEGIN = no_data, typename END = no_data> class tx_generator : public tx_generator_base {
 public:
     tx_generator(const char* name, tx_fiber& s, bool with_events = false)
@@ -417,73 +851,66 @@ public:
 
     virtual ~tx_generator() = default;
 
-    tx_handle begin_tx() { return tx_generator_base::begin_tx(value(), sc_core::sc_time_stamp(), 0); }
+    tx_handle begin_tx() { return tx_generator_base::begin_tx(no_data(), sc_core::sc_time_stamp(), 0); }
 
     tx_handle begin_tx(tx_relation_handle relation_h, tx_handle const& other_tx_h) {
-        return tx_generator_base::begin_tx(value(), sc_core::sc_time_stamp(), relation_h, &other_tx_h);
+        return tx_generator_base::begin_tx(no_data(), sc_core::sc_time_stamp(), relation_h, &other_tx_h);
     }
 
     tx_handle begin_tx(const char* relation_name, tx_handle const& other_tx_h) {
-        return tx_generator_base::begin_tx(value(), sc_core::sc_time_stamp(), get_tx_fiber().get_tx_db()->create_relation(relation_name),
-                                           &other_tx_h);
+        return tx_generator_base::begin_tx(no_data(), sc_core::sc_time_stamp(), relation_name, other_tx_h);
     }
 
-    tx_handle begin_tx(BEGIN const& begin_attr) {
-        auto v = ::lwtr::record(begin_attr);
-        return tx_generator_base::begin_tx(v, sc_core::sc_time_stamp(), 0);
-    }
+    tx_handle begin_tx(BEGIN const& begin_attr) { return tx_generator_base::begin_tx(begin_attr, sc_core::sc_time_stamp(), 0); }
 
     tx_handle begin_tx(const BEGIN& begin_attr, tx_relation_handle relation_h, const tx_handle& other_tx_h) {
-        auto v = lwtr::record(begin_attr);
-        return tx_generator_base::begin_tx(v, sc_core::sc_time_stamp(), relation_h, &other_tx_h);
+        return tx_generator_base::begin_tx(begin_attr, sc_core::sc_time_stamp(), relation_h, &other_tx_h);
     }
 
     tx_handle begin_tx(const BEGIN& begin_attr, const char* relation_name, const tx_handle& other_tx_h) {
-        auto v = lwtr::record(begin_attr);
-        return tx_generator_base::begin_tx(v, sc_core::sc_time_stamp(), get_tx_fiber().get_tx_db()->create_relation(relation_name),
-                                           &other_tx_h);
+        return tx_generator_base::begin_tx(begin_attr, sc_core::sc_time_stamp(), relation_name, other_tx_h);
     }
 
-    tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time) { return tx_generator_base::begin_tx(value(), begin_sc_time, 0); }
+    tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time) { return tx_generator_base::begin_tx(no_data(), begin_sc_time, 0); }
 
     tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time, tx_relation_handle relation_h, const tx_handle& other_tx_h) {
-        return tx_generator_base::begin_tx(value(), begin_sc_time, relation_h, &other_tx_h);
+        return tx_generator_base::begin_tx(no_data(), begin_sc_time, relation_h, &other_tx_h);
     }
 
     tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time, const char* relation_name, const tx_handle& other_tx_h) {
-        return tx_generator_base::begin_tx(value(), begin_sc_time, get_tx_fiber().get_tx_db()->create_relation(relation_name), &other_tx_h);
+        return tx_generator_base::begin_tx(no_data(), begin_sc_time, relation_name, other_tx_h);
     }
 
     tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time, const BEGIN& begin_attr) {
-        auto v = lwtr::record(begin_attr);
-        return tx_generator_base::begin_tx(v, begin_sc_time, 0);
+        return tx_generator_base::begin_tx(begin_attr, begin_sc_time, 0);
     }
 
     tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time, const BEGIN& begin_attr, tx_relation_handle relation_h,
                                const tx_handle& other_tx_h) {
-        auto v = lwtr::record(begin_attr);
-        return tx_generator_base::begin_tx(v, begin_sc_time, relation_h, &other_tx_h);
+        return tx_generator_base::begin_tx(begin_attr, begin_sc_time, relation_h, &other_tx_h);
     }
 
     tx_handle begin_tx_delayed(sc_core::sc_time const& begin_sc_time, const BEGIN& begin_attr, const char* relation_name,
                                const tx_handle& other_tx_h) {
-        auto v = lwtr::record(begin_attr);
-        return tx_generator_base::begin_tx(v, begin_sc_time, get_tx_fiber().get_tx_db()->create_relation(relation_name), &other_tx_h);
+        return tx_generator_base::begin_tx(begin_attr, begin_sc_time, relation_name, other_tx_h);
     }
 
-    void end_tx(tx_handle& t) { tx_generator_base::end_tx(t, value(), sc_core::sc_time_stamp()); }
+    void end_tx(tx_handle& t) { tx_generator_base::end_tx(t, no_data(), sc_core::sc_time_stamp()); }
 
-    void end_tx(tx_handle& t, const END& end_attr) {
-        auto v = ::lwtr::record(end_attr);
-        tx_generator_base::end_tx(t, v, sc_core::sc_time_stamp());
-    }
+    void end_tx(tx_handle& t, const END& end_attr) { tx_generator_base::end_tx(t, end_attr, sc_core::sc_time_stamp()); }
 
-    void end_tx_delayed(tx_handle& t, sc_core::sc_time const& end_sc_time) { tx_generator_base::end_tx(t, value(), end_sc_time); }
+    void end_tx_delayed(tx_handle& t, sc_core::sc_time const& end_sc_time) { tx_generator_base::end_tx(t, no_data(), end_sc_time); }
 
     void end_tx_delayed(tx_handle& t, sc_core::sc_time const& end_sc_time, const END& end_attr) {
-        auto v = lwtr::record(end_attr);
-        tx_generator_base::end_tx(t, v, end_sc_time);
+        tx_generator_base::end_tx(t, end_attr, end_sc_time);
     }
+    /**
+     * records complete transactions in one call without creating a tx_handle per transaction, e.g. if a model computes
+     * the timing of several transactions at once. A transaction having a parent is related to it using "parent_of".
+     */
+    void record_txs(tx_record<BEGIN, END> const* txs, size_t count) { tx_generator_base::record_txs(txs, count); }
+
+    void record_txs(std::vector<tx_record<BEGIN, END>> const& txs) { tx_generator_base::record_txs(txs.data(), txs.size()); }
 
 private:
     tx_generator(const char* name, tx_fiber& s, std::string const& attribute_name, std::false_type, bool b)
@@ -499,5 +926,45 @@ void tx_text_gz_init();
 
 void tx_text_lz4_init();
 
-void tx_ftr_init(bool compressed);
+/// compression algorithms of the FTR backend
+enum class ftr_codec { LZ4, LZ4_HC, ZSTD };
+
+/**
+ * layout of the tx blocks of the FTR backend. PLAIN keeps the chunks and value encodings of the original format (no
+ * packed vectors or inline strings) so older readers can read uncompressed and LZ4 compressed files without compression
+ * dictionaries. DELTA and COLUMNAR (each field stored separately) need a reader supporting them.
+ */
+enum class ftr_block_format { PLAIN, DELTA, COLUMNAR };
+
+/// settings of the FTR backend
+struct ftr_config {
+    bool compressed{false};
+    /// algorithm used if compressed is set, ZSTD falls back to LZ4 if the library was built without zstd
+    ftr_codec codec{ftr_codec::LZ4};
+    /// acceleration factor of LZ4, compression level of LZ4_HC and ZSTD, 0 selects the default of the codec
+    int level{0};
+    /// size of the LZ4 compression dictionary each stream derives from its first tx block (at most 64KiB), 0 disables them
+    size_t dictionary_size{0};
+    /// ids and time stamps of the transactions in a tx block are stored as differences to the preceding transaction
+    ftr_block_format block_format{ftr_block_format::DELTA};
+    /// size in bytes at which the buffered tx block of a fiber is written, it caps the data buffered per fiber
+    size_t block_size{1 << 16};
+    /// limit of the tx data buffered for all fibers in bytes, if exceeded the oldest blocks are written first. 0 disables it
+    size_t memory_budget{0};
+    /// simulation time after which a buffered tx block is written regardless of its size, SC_ZERO_TIME disables it
+    sc_core::sc_time max_block_age{sc_core::SC_ZERO_TIME};
+    /// number of distinct string values of an attribute which are stored in the dictionary, further values are written
+    /// inline. 0 stores all strings in the dictionary, so does the PLAIN block format
+    size_t max_distinct_strings{4096};
+    /// size of the write buffer of the output file, it is rounded up to full pages
+    size_t buffer_size{1 << 20};
+    /// number of chunks queued for the writer threads, 0 compresses and writes chunks on the recording thread
+    unsigned queue_depth{16};
+    /// number of threads compressing the chunks of one tx_db concurrently, 0 uses all hardware threads
+    unsigned compression_threads{2};
+};
+
+void tx_ftr_init(ftr_config const&);
+
+void tx_ftr_init(bool compressed, size_t buffer_size = 1 << 20);
 } // namespace lwtr
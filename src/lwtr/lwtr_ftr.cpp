@@ -16,217 +16,433 @@
 
 #include "lwtr.h"
 #include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <ftr/ftr_writer.h>
+#include <mutex>
 #include <numeric>
 #include <sstream>
+#include <thread>
 #include <sysc/utils/sc_report.h>
 
 namespace lwtr {
 namespace {
 // ----------------------------------------------------------------------------
+// moves the lower 32 bits of x to the even bit positions
+inline uint64_t spread_bits(uint64_t x) {
+    x = (x | x << 16) & 0x0000ffff0000ffffULL;
+    x = (x | x << 8) & 0x00ff00ff00ff00ffULL;
+    x = (x | x << 4) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | x << 2) & 0x3333333333333333ULL;
+    return (x | x << 1) & 0x5555555555555555ULL;
+}
+/**
+ * packs a bit vector (BITS = 1) or logic vector (BITS = 2, data and control bit forming the sc_logic_value_t) into a
+ * thread local buffer which stays valid until the next call. The loop works on whole SystemC words without branches
+ * so the compiler can vectorize it.
+ */
+template <unsigned BITS, typename V> ftr::packed_vector pack(V const& v) {
+    static thread_local std::vector<uint8_t> buffer;
+    auto const words = static_cast<size_t>(v.size());
+    buffer.resize(words * 4 * BITS);
+    auto* out = buffer.data();
+    for(size_t i = 0; i < words; ++i) {
+        uint64_t w = v.get_word(static_cast<int>(i));
+        if(BITS == 2)
+            w = spread_bits(w) | spread_bits(v.get_cword(static_cast<int>(i))) << 1;
+        for(unsigned b = 0; b < 4 * BITS; ++b)
+            out[i * 4 * BITS + b] = static_cast<uint8_t>(w >> (8 * b));
+    }
+    uint64_t const length = v.length();
+    auto const size = static_cast<size_t>((length * BITS + 7) / 8);
+    if(auto const tail = (length * BITS) % 8)
+        out[size - 1] &= static_cast<uint8_t>((1U << tail) - 1);
+    return {length, out, size};
+}
+// ----------------------------------------------------------------------------
+/**
+ * converts sc_time into the integer time stamps of a database. The divisor between the kernel resolution and the time
+ * unit of the database is a power of 10 and determined once, so the conversion needs no floating point math. A unit
+ * finer than the kernel resolution is raised to it as it would only scale all time stamps and let them overflow early.
+ */
+struct time_scale {
+    // exponent of the time unit in seconds as written to the info chunk
+    int exponent{-12};
+    uint64_t divisor{1};
+
+    time_scale() = default;
+
+    explicit time_scale(sc_core::sc_time_unit unit) {
+        auto const resolution = static_cast<int>(std::lround(std::log10(sc_core::sc_time::from_value(1ULL).to_seconds())));
+        exponent = std::max(3 * static_cast<int>(unit) - 15, resolution);
+        for(auto e = resolution; e < exponent; ++e)
+            divisor *= 10;
+    }
+
+    uint64_t operator()(sc_core::sc_time const& t) const { return divisor == 1 ? t.value() : t.value() / divisor; }
+};
+// ----------------------------------------------------------------------------
 template <typename WRITER> struct Writer {
     std::unique_ptr<WRITER> output_writer;
+    // converts sc_time into time stamps in the time unit of the database
+    time_scale to_time_stamp;
     Writer(const std::string& name)
     : output_writer(new WRITER(name)) {}
 
     Writer() = default;
 
-    inline bool open(const std::string& name) {
-        output_writer.reset(new WRITER(name));
-        return output_writer->cw.enc.ofs.is_open();
+    inline bool open(const std::string& name, ftr_config const& cfg, time_scale const& scale) {
+        to_time_stamp = scale;
+        auto threads = cfg.compression_threads ? cfg.compression_threads : std::max(1U, std::thread::hardware_concurrency());
+        ftr::compression comp;
+        comp.algorithm = static_cast<ftr::codec>(cfg.codec);
+        comp.level = cfg.level;
+        comp.dictionary_size = cfg.dictionary_size;
+        ftr::block_policy policy;
+        policy.format = static_cast<ftr::block_format>(cfg.block_format);
+        policy.block_size = cfg.block_size;
+        policy.memory_budget = cfg.memory_budget;
+        policy.max_age = to_time_stamp(cfg.max_block_age);
+        policy.max_distinct_strings = cfg.max_distinct_strings;
+        output_writer.reset(new WRITER(name, cfg.buffer_size, cfg.queue_depth, threads, comp, policy));
+        return output_writer->cw.enc.is_open();
     }
 
-    inline void close() { output_writer.reset(nullptr); }
-
-    inline bool is_open() { return output_writer->cw.enc.ofs.is_open(); }
-
-    inline static WRITER& writer() { return *get().output_writer; }
-
-    inline static Writer& get() {
-        static Writer db;
-        return db;
+    // returns errno of the first failed write or 0
+    inline int close() {
+        output_writer->close();
+        auto err = output_writer->error();
+        output_writer.reset(nullptr);
+        return err;
     }
 
-    static inline void writeAttribute(uint64_t tx_id, ftr::event_type pos, nonstd::string_view const& name, value const& v) {
-        std::array<char, 1024> hier_full_name;
-        if(name.length())
-            strncpy(hier_full_name.data(), name.data(), name.length());
-        writeAttribute(tx_id, pos, v, hier_full_name.data(), hier_full_name.data() + name.length());
-    }
+    inline bool is_open() { return output_writer->cw.enc.is_open(); }
 
-private:
-    static inline nonstd::string_view get_full_name(char const* hier_full_name, char* insert_point) {
-        assert(insert_point >= hier_full_name);
-        if(insert_point == hier_full_name)
-            return "unnamed";
-        *insert_point = 0;
-        return {hier_full_name, static_cast<unsigned>(insert_point - hier_full_name)};
-    }
+    inline WRITER& writer() { return *output_writer; }
 
-    static void writeAttribute(uint64_t tx_id, ftr::event_type pos, value const& v, char const* hier_full_name, char* insert_point) {
+    // passes the FTR data type and the encodable representation of a leaf value to f
+    template <typename F> void visit(value const& v, F const& f) const {
         switch(v.index()) {
-        case 0: // no data
-            break;
         case 1: // std::string
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::STRING, nonstd::get<1>(v));
+            f(ftr::data_type::STRING, nonstd::get<1>(v));
             break;
         case 2: // char*
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::STRING, nonstd::get<2>(v));
+            f(ftr::data_type::STRING, nonstd::get<2>(v));
             break;
         case 3: // double
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::FLOATING_POINT_NUMBER,
-                                    nonstd::get<3>(v));
+            f(ftr::data_type::FLOATING_POINT_NUMBER, nonstd::get<3>(v));
             break;
         case 4: // bool
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::BOOLEAN, nonstd::get<4>(v));
+            f(ftr::data_type::BOOLEAN, nonstd::get<4>(v));
             break;
         case 5: // uint64_t,
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::UNSIGNED, nonstd::get<5>(v));
+            f(ftr::data_type::UNSIGNED, nonstd::get<5>(v));
             break;
         case 6: // int64_t,
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::INTEGER, nonstd::get<6>(v));
+            f(ftr::data_type::INTEGER, nonstd::get<6>(v));
             break;
         case 7: // sc_dt::sc_bv_base
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::BIT_VECTOR,
-                                    nonstd::get<7>(v).to_string());
+            f(ftr::data_type::BIT_VECTOR, pack<1>(nonstd::get<7>(v)));
             break;
         case 8: // sc_dt::sc_lv_base
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::LOGIC_VECTOR,
-                                    nonstd::get<8>(v).to_string());
+            f(ftr::data_type::LOGIC_VECTOR, pack<2>(nonstd::get<8>(v)));
             break;
         case 9: // sc_core::sc_time
-            writer().writeAttribute(tx_id, pos, get_full_name(hier_full_name, insert_point), ftr::data_type::TIME,
-                                    nonstd::get<9>(v).value());
+            f(ftr::data_type::TIME, to_time_stamp(nonstd::get<9>(v)));
             break;
-        case 10: // object
-            for(auto& e : nonstd::get<10>(v)) {
-                auto const& name = std::get<0>(e);
-                auto old_insert_point = insert_point;
-                if(insert_point != hier_full_name)
-                    *insert_point = '.';
-                auto res = strncpy(++insert_point, name.c_str(), name.length());
-                insert_point += name.length();
-                writeAttribute(tx_id, pos, std::get<1>(e), hier_full_name, insert_point);
-                insert_point = old_insert_point;
-            }
+        default: // no data and objects are resolved by the frontend
             break;
         }
     }
+
+    // TX is either the id or the ftr::tx_entry of the transaction
+    template <typename TX> struct tx_attribute {
+        WRITER& w;
+        TX tx;
+        ftr::event_type event;
+        unsigned idx;
+        nonstd::string_view const& name;
+        template <typename T> void operator()(ftr::data_type type, T const& v) const { w.writeAttribute(tx, event, idx, name, type, v); }
+    };
+
+    struct complete_tx_attribute {
+        WRITER& w;
+        ftr::event_type event;
+        unsigned idx;
+        nonstd::string_view const& name;
+        template <typename T> void operator()(ftr::data_type type, T const& v) const {
+            w.writeTransactionAttribute(event, idx, name, type, v);
+        }
+    };
+
+    template <typename TX> void writeAttribute(TX tx, ftr::event_type pos, unsigned idx, nonstd::string_view const& name, value const& v) {
+        visit(v, tx_attribute<TX>{writer(), tx, pos, idx, name});
+    }
+    // attribute of the transaction started last by WRITER::writeTransaction()
+    void writeTransactionAttribute(ftr::event_type pos, unsigned idx, nonstd::string_view const& name, value const& v) {
+        visit(v, complete_tx_attribute{writer(), pos, idx, name});
+    }
 };
 // ----------------------------------------------------------------------------
-template <typename DB> void tx_db_cbf(tx_db const& _tx_db, callback_reason reason) {
-    static std::string file_name("tx_default");
-    switch(reason) {
-    case CREATE: {
-        if(_tx_db.get_name().length() != 0) {
-            file_name = _tx_db.get_name();
-        }
-        file_name += ".ftr";
-        if(Writer<DB>::get().open(file_name)) {
-            double secs = sc_core::sc_time::from_value(1ULL).to_seconds();
-            auto exp = rint(log(secs) / log(10.0));
-            Writer<DB>::writer().writeInfo(static_cast<int8_t>(exp));
-            std::stringstream ss;
-            ss << "opening file " << file_name;
-            SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
-        } else {
-            std::stringstream ss;
-            ss << "Can't open text recording file. " << strerror(errno);
-            SC_REPORT_ERROR(__FUNCTION__, ss.str().c_str());
+// an event recorded in thread-safe mode, it is kept in the staging buffer of the recording thread until it is merged
+struct staged_op {
+    enum op_kind { BEGIN, ATTRIBUTE, END, RELATION } kind;
+    ftr::event_type event;
+    unsigned idx;
+    uint64_t id;           // the transaction, for relations the source transaction
+    uint64_t generator;    // BEGIN only
+    uint64_t stream;       // BEGIN and RELATION
+    uint64_t time;         // BEGIN and END
+    uint64_t other_id;     // RELATION only
+    uint64_t other_stream; // RELATION only
+    tx_relation_handle relation;
+    std::string name; // attribute name
+    value v;
+};
+// distinguishes backend instances in the thread local lookup as addresses might get reused
+std::atomic<uint64_t> backend_serial{0};
+// ----------------------------------------------------------------------------
+static_assert(tx_backend::no_index == ftr::no_index, "attribute indices are passed to the writer unchanged");
+
+template <typename DB> struct tx_ftr_backend : public tx_backend {
+    using stage = std::vector<staged_op>;
+    // number of staged events after which a thread merges its staging buffer into the writer
+    static constexpr size_t stage_size = 4096;
+
+    std::string const file_name;
+    Writer<DB> db;
+    bool const thread_safe;
+    uint64_t const serial;
+    std::mutex writer_mtx;
+    std::vector<std::unique_ptr<stage>> stages;
+    // events of transactions whose begin is still in the staging buffer of another thread
+    stage deferred;
+    tx_db const& tx_database;
+    // dictionary keys of the relation names indexed by relation handle
+    std::vector<uint64_t> relation_keys;
+
+    tx_ftr_backend(std::string const& file_name, Writer<DB>&& db, tx_db const& tx_database)
+    : file_name(file_name)
+    , db(std::move(db))
+    , thread_safe(tx_db::is_thread_safe())
+    , serial(++backend_serial)
+    , tx_database(tx_database) {}
+
+    ~tx_ftr_backend() {
+        for(auto& s : stages)
+            merge(*s);
+        if(deferred.size()) {
+            std::stringstream ds;
+            ds << deferred.size() << " events of transactions which were never begun are dropped from " << file_name;
+            SC_REPORT_WARNING(__FUNCTION__, ds.str().c_str());
         }
-    } break;
-    case DELETE: {
         std::stringstream ss;
         ss << "closing file " << file_name;
         SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
-        Writer<DB>::get().close();
-    } break;
-    default:
-        SC_REPORT_ERROR(__FUNCTION__, "Unknown reason in tx_db callback");
+        // an error is not thrown from the destructor, the data written after it is lost
+        if(auto err = db.close()) {
+            std::stringstream es;
+            es << "writing file " << file_name << " failed: " << std::strerror(err);
+            SC_REPORT_WARNING(__FUNCTION__, es.str().c_str());
+        }
     }
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_fiber_cbf(const tx_fiber& s, callback_reason reason) {
-    if(Writer<DB>::get().is_open() && reason == CREATE) {
-        Writer<DB>::writer().writeStream(s.get_id(), s.get_name(), s.get_fiber_kind());
+
+    void create_fiber(tx_fiber const& s) override {
+        auto lock = lock_writer();
+        db.writer().writeStream(s.get_id(), s.get_name(), s.get_fiber_kind());
     }
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_generator_cbf(const tx_generator_base& g, callback_reason reason) {
-    if(Writer<DB>::get().is_open() && reason == CREATE) {
-        Writer<DB>::writer().writeGenerator(g.get_id(), g.get_name(), g.get_tx_fiber().get_id());
+
+    void create_generator(tx_generator_base const& g) override {
+        auto lock = lock_writer();
+        db.writer().writeGenerator(g.get_id(), g.get_name(), g.get_tx_fiber().get_id());
     }
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_handle_cbf(const tx_handle& t, callback_reason reason, value const& v) {
-    if(!Writer<DB>::get().is_open())
-        return;
-    if(t.get_tx_fiber().get_tx_db() == nullptr)
-        return;
-    if(t.get_tx_fiber().get_tx_db()->get_recording() == false)
-        return;
-    switch(reason) {
-    case BEGIN: {
-        Writer<DB>::writer().startTransaction(t.get_id(), t.get_tx_generator_base().get_id(),
-                                              t.get_tx_generator_base().get_tx_fiber().get_id(),
-                                              t.get_begin_sc_time() / sc_core::sc_time(1, sc_core::SC_PS));
-        auto const& name = t.get_tx_generator_base().get_begin_attribute_name();
-        if(name.length())
-            Writer<DB>::writeAttribute(t.get_id(), ftr::event_type::BEGIN, name, v);
-    } break;
-    case END: {
-        auto const& name = t.get_tx_generator_base().get_end_attribute_name();
-        if(name.length())
-            Writer<DB>::writeAttribute(t.get_id(), ftr::event_type::END, name, v);
-        Writer<DB>::writer().endTransaction(t.get_id(), t.get_end_sc_time() / sc_core::sc_time(1, sc_core::SC_PS));
-    } break;
-    default:;
+
+    void begin_tx(tx_handle const& t) override {
+        auto const& gen = t.get_tx_generator_base();
+        auto time = db.to_time_stamp(t.get_begin_sc_time());
+        if(!thread_safe) {
+            t.set_backend_data(get_slot(), db.writer().beginTransaction(t.get_id(), gen.get_id(), gen.get_tx_fiber().get_id(), time));
+            return;
+        }
+        auto& op = stage_op(staged_op::BEGIN, t.get_id());
+        op.generator = gen.get_id();
+        op.stream = gen.get_tx_fiber().get_id();
+        op.time = time;
     }
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_handle_record_attribute_cbf(tx_handle const& t, const char* attribute_name, value const& v) {
-    if(t.get_tx_fiber().get_tx_db() == nullptr)
-        return;
-    if(t.get_tx_fiber().get_tx_db()->get_recording() == false)
-        return;
-    if(!Writer<DB>::get().is_open())
-        return;
-    Writer<DB>::writeAttribute(t.get_id(), ftr::event_type::RECORD, attribute_name == nullptr ? "" : attribute_name, v);
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_handle_relation_cbf(const tx_handle& tr_1, const tx_handle& tr_2, tx_relation_handle relation_handle) {
-    auto const& f_1 = tr_1.get_tx_fiber();
-    if(f_1.get_tx_db() == nullptr)
-        return;
-    if(f_1.get_tx_db()->get_recording() == false)
-        return;
-    if(Writer<DB>::get().is_open()) {
+
+    void record_attribute(tx_handle const& t, event_type event, unsigned idx, nonstd::string_view const& name, value const& v) override {
+        if(!thread_safe) {
+            if(auto* e = static_cast<ftr::tx_entry*>(t.get_backend_data(get_slot())))
+                db.writeAttribute(e, static_cast<ftr::event_type>(event), idx, name, v);
+            return;
+        }
+        auto& op = stage_op(staged_op::ATTRIBUTE, t.get_id());
+        op.event = static_cast<ftr::event_type>(event);
+        op.idx = idx;
+        op.name.assign(name.data(), name.size());
+        // C strings are copied as the staged event outlives the caller's buffer
+        if(v.index() == 2)
+            op.v = std::string(nonstd::get<2>(v));
+        else
+            op.v = v;
+    }
+
+    void end_tx(tx_handle const& t) override {
+        auto time = db.to_time_stamp(t.get_end_sc_time());
+        if(!thread_safe) {
+            if(auto* e = static_cast<ftr::tx_entry*>(t.get_backend_data(get_slot()))) {
+                db.writer().endTransaction(e, time);
+                t.set_backend_data(get_slot(), nullptr);
+            }
+            return;
+        }
+        stage_op(staged_op::END, t.get_id()).time = time;
+    }
+
+    void add_relation(tx_handle const& tr_1, tx_handle const& tr_2, tx_relation_handle relation_handle) override {
+        auto const& f_1 = tr_1.get_tx_fiber();
         auto const& f_2 = tr_2.get_tx_fiber();
-        Writer<DB>::writer().writeRelation(f_1.get_tx_db()->get_relation_name(relation_handle), f_1.get_id(), tr_1.get_id(), f_2.get_id(),
-                                           tr_2.get_id());
+        if(!thread_safe) {
+            db.writer().writeRelation(get_relation_key(relation_handle), f_1.get_id(), tr_1.get_id(), f_2.get_id(), tr_2.get_id());
+            return;
+        }
+        auto& op = stage_op(staged_op::RELATION, tr_1.get_id());
+        op.relation = relation_handle;
+        op.stream = f_1.get_id();
+        op.other_id = tr_2.get_id();
+        op.other_stream = f_2.get_id();
     }
+    // the batch is already complete so even in thread-safe mode it is written directly
+    void record_txs(tx_generator_base const& gen, tx_batch const& batch) override {
+        auto lock = lock_writer();
+        auto& w = db.writer();
+        auto const stream = gen.get_tx_fiber().get_id();
+        for(auto& e : batch.txs) {
+            w.writeTransaction(e.id, gen.get_id(), stream, db.to_time_stamp(e.begin_time), db.to_time_stamp(e.end_time),
+                               e.attribute_count);
+            for(auto i = e.first_attribute; i < e.first_attribute + e.attribute_count; ++i) {
+                auto& a = batch.attributes[i];
+                db.writeTransactionAttribute(static_cast<ftr::event_type>(a.event), a.index, a.name, a.v);
+            }
+            if(e.parent)
+                w.writeRelation(get_relation_key(batch.parent_relation), stream, e.id, e.parent->get_tx_fiber().get_id(),
+                                e.parent->get_id());
+        }
+    }
+
+private:
+    uint64_t get_relation_key(tx_relation_handle relation_handle) {
+        if(relation_handle >= relation_keys.size())
+            relation_keys.resize(relation_handle + 1, std::numeric_limits<uint64_t>::max());
+        auto& key = relation_keys[relation_handle];
+        if(key == std::numeric_limits<uint64_t>::max())
+            key = db.writer().getRelationKey(tx_database.get_relation_name(relation_handle));
+        return key;
+    }
+
+    std::unique_lock<std::mutex> lock_writer() {
+        std::unique_lock<std::mutex> lock(writer_mtx, std::defer_lock);
+        if(thread_safe)
+            lock.lock();
+        return lock;
+    }
+    // returns the staging buffer of the calling thread, it is owned by the backend so it survives the thread
+    stage& thread_stage() {
+        thread_local std::vector<std::pair<uint64_t, stage*>> thread_stages;
+        for(auto& e : thread_stages)
+            if(e.first == serial)
+                return *e.second;
+        std::lock_guard<std::mutex> lock(writer_mtx);
+        stages.emplace_back(new stage());
+        stages.back()->reserve(stage_size);
+        thread_stages.emplace_back(serial, stages.back().get());
+        return *stages.back();
+    }
+
+    staged_op& stage_op(staged_op::op_kind kind, uint64_t id) {
+        auto& s = thread_stage();
+        if(s.size() >= stage_size) {
+            std::lock_guard<std::mutex> lock(writer_mtx);
+            merge(s);
+        }
+        s.emplace_back();
+        s.back().kind = kind;
+        s.back().id = id;
+        return s.back();
+    }
+    // merges a staging buffer and retries the deferred events, the caller needs to hold the writer lock
+    void merge(stage& s) {
+        replay(s);
+        s.clear();
+        if(deferred.size()) {
+            stage pending;
+            pending.swap(deferred);
+            replay(pending);
+        }
+    }
+    // replays the staged events in the order they were recorded. A transaction handed over to another thread may be
+    // ended in a buffer merged before the one holding its begin, such events are deferred until the begin is merged.
+    void replay(stage& s) {
+        auto& w = db.writer();
+        for(auto& op : s)
+            switch(op.kind) {
+            case staged_op::BEGIN:
+                w.startTransaction(op.id, op.generator, op.stream, op.time);
+                break;
+            case staged_op::ATTRIBUTE:
+                if(w.hasTransaction(op.id))
+                    db.writeAttribute(op.id, op.event, op.idx, op.name, op.v);
+                else
+                    deferred.push_back(std::move(op));
+                break;
+            case staged_op::END:
+                if(!w.endTransaction(op.id, op.time))
+                    deferred.push_back(std::move(op));
+                break;
+            case staged_op::RELATION:
+                w.writeRelation(get_relation_key(op.relation), op.stream, op.id, op.other_stream, op.other_id);
+                break;
+            }
+    }
+};
+// ----------------------------------------------------------------------------
+template <typename DB> std::unique_ptr<tx_backend> create_backend(tx_db const& _tx_db, ftr_config const& cfg) {
+    auto file_name = (_tx_db.get_name().length() ? _tx_db.get_name() : std::string("tx_default")) + ".ftr";
+    Writer<DB> db;
+    time_scale scale(_tx_db.get_time_unit());
+    if(db.open(file_name, cfg, scale)) {
+        db.writer().writeInfo(static_cast<int8_t>(scale.exponent));
+        std::stringstream ss;
+        ss << "opening file " << file_name;
+        SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
+        return std::unique_ptr<tx_backend>(new tx_ftr_backend<DB>(file_name, std::move(db), _tx_db));
+    }
+    std::stringstream ss;
+    ss << "Can't open text recording file. " << strerror(errno);
+    SC_REPORT_ERROR(__FUNCTION__, ss.str().c_str());
+    return nullptr;
 }
 // ----------------------------------------------------------------------------
 } // namespace
 // ----------------------------------------------------------------------------
-void tx_ftr_init(bool compressed) {
-    if(compressed) {
-        tx_db::register_class_cb(tx_db_cbf<ftr::ftr_writer<true>>);
-        tx_fiber::register_class_cb(tx_fiber_cbf<ftr::ftr_writer<true>>);
-        tx_generator_base::register_class_cb(tx_generator_cbf<ftr::ftr_writer<true>>);
-        tx_handle::register_class_cb(tx_handle_cbf<ftr::ftr_writer<true>>);
-        tx_handle::register_record_attribute_cb(tx_handle_record_attribute_cbf<ftr::ftr_writer<true>>);
-        tx_handle::register_relation_cb(tx_handle_relation_cbf<ftr::ftr_writer<true>>);
-    } else {
-        tx_db::register_class_cb(tx_db_cbf<ftr::ftr_writer<false>>);
-        tx_fiber::register_class_cb(tx_fiber_cbf<ftr::ftr_writer<false>>);
-        tx_generator_base::register_class_cb(tx_generator_cbf<ftr::ftr_writer<false>>);
-        tx_handle::register_class_cb(tx_handle_cbf<ftr::ftr_writer<false>>);
-        tx_handle::register_record_attribute_cb(tx_handle_record_attribute_cbf<ftr::ftr_writer<false>>);
-        tx_handle::register_relation_cb(tx_handle_relation_cbf<ftr::ftr_writer<false>>);
-    }
+void tx_ftr_init(ftr_config const& cfg) {
+#ifndef WITH_ZSTD
+    if(cfg.compressed && cfg.codec == ftr_codec::ZSTD)
+        SC_REPORT_WARNING(__FUNCTION__, "lwtr was built without zstd, falling back to LZ4 compression");
+#endif
+    if(cfg.compressed)
+        tx_db::register_backend([cfg](tx_db const& db) { return create_backend<ftr::ftr_writer<true>>(db, cfg); });
+    else
+        tx_db::register_backend([cfg](tx_db const& db) { return create_backend<ftr::ftr_writer<false>>(db, cfg); });
+}
+
+void tx_ftr_init(bool compressed, size_t buffer_size) {
+    ftr_config cfg;
+    cfg.compressed = compressed;
+    cfg.buffer_size = buffer_size;
+    tx_ftr_init(cfg);
 }
 } // namespace lwtr
 // ----------------------------------------------------------------------------
@@ -21,6 +21,7 @@
 #include <fmt/format.h>
 #include <fmt/printf.h>
 #include <fstream>
+#include <mutex>
 #include <numeric>
 #include <sstream>
 #include <string>
@@ -126,203 +127,149 @@ template <typename WRITER> struct Writer {
         writer->write(fmt::format(fmt::runtime(std::string(format)), std::forward<Args>(args)...));
     }
 
-    inline std::string const& get_extension() { return WRITER::extension; }
-
-    inline static Writer& get() {
-        static Writer db;
-        return db;
-    }
+    inline static std::string const& get_extension() { return WRITER::extension; }
 };
 // ----------------------------------------------------------------------------
-template <typename DB> void tx_db_cbf(tx_db const& _tx_db, callback_reason reason) {
-    static std::string file_name("tx_default");
-    switch(reason) {
-    case CREATE: {
-        if(_tx_db.get_name().length() != 0) {
-            file_name = _tx_db.get_name();
-        }
-        file_name += "." + Writer<DB>::get().get_extension();
-        if(Writer<DB>::get().open(file_name)) {
-            std::stringstream ss;
-            ss << "opening file " << file_name;
-            SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
-        } else {
-            std::stringstream ss;
-            ss << "Can't open text recording file. " << strerror(errno);
-            SC_REPORT_ERROR(__FUNCTION__, ss.str().c_str());
-        }
-    } break;
-    case DELETE: {
-        std::stringstream ss;
-        ss << "closing file " << file_name;
-        SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
-        Writer<DB>::get().close();
-    } break;
-    default:
-        SC_REPORT_ERROR(__FUNCTION__, "Unknown reason in tx_db callback");
-    }
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_fiber_cbf(const tx_fiber& s, callback_reason reason) {
-    if(reason == CREATE) {
-        Writer<DB>::get().write("scv_tr_stream (ID {}, name \"{}\", kind \"{}\")\n", s.get_id(), s.get_name(),
-                                s.get_fiber_kind().length() ? s.get_fiber_kind() : "<no_stream_kind>");
-    }
-}
-// ----------------------------------------------------------------------------
 template <typename DB> struct value_visitor {
 
-    static inline void writeAttribute(uint64_t tx_id, nonstd::string_view const& name, value const& v) {
-        std::array<char, 1024> hier_full_name;
-        if(name.length())
-            strncpy(hier_full_name.data(), name.data(), name.length());
-        writeAttribute(tx_id, v, hier_full_name.data(), hier_full_name.data() + name.length());
-    }
-
-    static inline std::string get_full_name(char const* hier_full_name, char* insert_point) {
-        if(insert_point == hier_full_name)
-            return "unnamed";
-        *insert_point = 0;
-        return hier_full_name;
-    }
-
-    static void writeAttribute(uint64_t tx_id, value const& v, char const* hier_full_name, char* insert_point) {
+    static void writeAttribute(Writer<DB>& db, uint64_t tx_id, nonstd::string_view const& attr_name, value const& v) {
+        fmt::string_view name(attr_name.data(), attr_name.size());
         switch(v.index()) {
-        case 0: // no data
-            break;
         case 1: // std::string
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" STRING = \"{}\"\n", tx_id, get_full_name(hier_full_name, insert_point),
-                                    nonstd::get<1>(v));
+            db.write("tx_record_attribute {} \"{}\" STRING = \"{}\"\n", tx_id, name, nonstd::get<1>(v));
             break;
         case 2: // char*
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" STRING = \"{}\"\n", tx_id, get_full_name(hier_full_name, insert_point),
-                                    nonstd::get<2>(v));
+            db.write("tx_record_attribute {} \"{}\" STRING = \"{}\"\n", tx_id, name, nonstd::get<2>(v));
             break;
         case 3: // double
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" FLOATING_POINT_NUMBER = {}\n", tx_id,
-                                    get_full_name(hier_full_name, insert_point), nonstd::get<3>(v));
+            db.write("tx_record_attribute {} \"{}\" FLOATING_POINT_NUMBER = {}\n", tx_id, name, nonstd::get<3>(v));
             break;
         case 4: // bool
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" BOOLEAN = {}\n", tx_id, get_full_name(hier_full_name, insert_point),
-                                    nonstd::get<4>(v) ? "true" : "false");
+            db.write("tx_record_attribute {} \"{}\" BOOLEAN = {}\n", tx_id, name, nonstd::get<4>(v) ? "true" : "false");
             break;
         case 5: // uint64_t,
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" UNSIGNED = {}\n", tx_id, get_full_name(hier_full_name, insert_point),
-                                    nonstd::get<5>(v));
+            db.write("tx_record_attribute {} \"{}\" UNSIGNED = {}\n", tx_id, name, nonstd::get<5>(v));
             break;
         case 6: // int64_t,
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" INTEGER = {}\n", tx_id, get_full_name(hier_full_name, insert_point),
-                                    nonstd::get<6>(v));
+            db.write("tx_record_attribute {} \"{}\" INTEGER = {}\n", tx_id, name, nonstd::get<6>(v));
             break;
         case 7: // sc_dt::sc_bv_base
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" BIT_VECTOR = \"{}\"\n", tx_id,
-                                    get_full_name(hier_full_name, insert_point), nonstd::get<7>(v).to_string());
+            db.write("tx_record_attribute {} \"{}\" BIT_VECTOR = \"{}\"\n", tx_id, name, nonstd::get<7>(v).to_string());
             break;
         case 8: // sc_dt::sc_lv_base
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" LOGIC_VECTOR = \"{}\"\n", tx_id,
-                                    get_full_name(hier_full_name, insert_point), nonstd::get<8>(v).to_string());
+            db.write("tx_record_attribute {} \"{}\" LOGIC_VECTOR = \"{}\"\n", tx_id, name, nonstd::get<8>(v).to_string());
             break;
         case 9: // sc_core::sc_time
-            Writer<DB>::get().write("tx_record_attribute {} \"{}\" STRING = \"{}\"\n", tx_id, get_full_name(hier_full_name, insert_point),
-                                    nonstd::get<9>(v).to_string());
+            db.write("tx_record_attribute {} \"{}\" STRING = \"{}\"\n", tx_id, name, nonstd::get<9>(v).to_string());
             break;
-        case 10: // object
-            for(auto& e : nonstd::get<10>(v)) {
-                auto const& name = std::get<0>(e);
-                auto old_insert_point = insert_point;
-                if(insert_point != hier_full_name)
-                    *insert_point = '.';
-                auto res = strncpy(++insert_point, name.c_str(), name.length());
-                insert_point += name.length();
-                writeAttribute(tx_id, std::get<1>(e), hier_full_name, insert_point);
-                insert_point = old_insert_point;
-            }
+        default: // no data and objects are resolved by the frontend
             break;
         }
     }
 };
 // ----------------------------------------------------------------------------
-template <typename DB> void tx_generator_cbf(const tx_generator_base& g, callback_reason reason) {
-    if(reason != CREATE)
-        return;
-    if(!Writer<DB>::get().is_open())
-        return;
-    Writer<DB>::get().write("scv_tr_generator (ID {}, name \"{}\", scv_tr_stream {},\n)\n", g.get_id(), g.get_name(),
-                            g.get_tx_fiber().get_id());
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_handle_cbf(const tx_handle& t, callback_reason reason, value const& v) {
-    if(!Writer<DB>::get().is_open())
-        return;
-    if(t.get_tx_fiber().get_tx_db() == nullptr)
-        return;
-    if(t.get_tx_fiber().get_tx_db()->get_recording() == false)
-        return;
-    switch(reason) {
-    case BEGIN: {
-        Writer<DB>::get().write("tx_begin {} {} {}\n", t.get_id(), t.get_tx_generator_base().get_id(), t.get_begin_sc_time().to_string());
-        value_visitor<DB>::writeAttribute(t.get_id(), t.get_tx_generator_base().get_begin_attribute_name(), v);
-    } break;
-    case END: {
-        value_visitor<DB>::writeAttribute(t.get_id(), t.get_tx_generator_base().get_begin_attribute_name(), v);
-        Writer<DB>::get().write("tx_end {} {} {}\n", t.get_id(), t.get_tx_generator_base().get_id(), t.get_end_sc_time().to_string());
-    } break;
-    default:;
+// in thread-safe mode each event is written under a lock, every line carries the transaction id so lines of
+// different threads may interleave
+template <typename DB> struct tx_text_backend : public tx_backend {
+    std::string const file_name;
+    Writer<DB> db;
+    bool const thread_safe;
+    std::mutex writer_mtx;
+
+    tx_text_backend(std::string const& file_name, Writer<DB>&& db)
+    : file_name(file_name)
+    , db(std::move(db))
+    , thread_safe(tx_db::is_thread_safe()) {}
+
+    ~tx_text_backend() {
+        std::stringstream ss;
+        ss << "closing file " << file_name;
+        SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
+        db.close();
     }
-}
-// ----------------------------------------------------------------------------
-template <typename DB> void tx_handle_record_attribute_cbf(tx_handle const& t, const char* attribute_name, value const& v) {
-    if(t.get_tx_fiber().get_tx_db() == nullptr)
-        return;
-    if(t.get_tx_fiber().get_tx_db()->get_recording() == false)
-        return;
-    if(!Writer<DB>::get().is_open())
-        return;
-    std::string tmp_str = attribute_name == nullptr ? "" : attribute_name;
-    value_visitor<DB>::writeAttribute(t.get_id(), tmp_str, v);
-}
+
+    void create_fiber(tx_fiber const& s) override {
+        auto lock = lock_writer();
+        db.write("scv_tr_stream (ID {}, name \"{}\", kind \"{}\")\n", s.get_id(), s.get_name(),
+                 s.get_fiber_kind().length() ? s.get_fiber_kind() : "<no_stream_kind>");
+    }
+
+    void create_generator(tx_generator_base const& g) override {
+        auto lock = lock_writer();
+        db.write("scv_tr_generator (ID {}, name \"{}\", scv_tr_stream {},\n)\n", g.get_id(), g.get_name(), g.get_tx_fiber().get_id());
+    }
+
+    void begin_tx(tx_handle const& t) override {
+        auto lock = lock_writer();
+        db.write("tx_begin {} {} {}\n", t.get_id(), t.get_tx_generator_base().get_id(), t.get_begin_sc_time().to_string());
+    }
+
+    void record_attribute(tx_handle const& t, event_type, unsigned, nonstd::string_view const& name, value const& v) override {
+        auto lock = lock_writer();
+        value_visitor<DB>::writeAttribute(db, t.get_id(), name, v);
+    }
+
+    void end_tx(tx_handle const& t) override {
+        auto lock = lock_writer();
+        db.write("tx_end {} {} {}\n", t.get_id(), t.get_tx_generator_base().get_id(), t.get_end_sc_time().to_string());
+    }
+
+    void add_relation(tx_handle const& tr_1, tx_handle const& tr_2, tx_relation_handle relation_handle) override {
+        auto lock = lock_writer();
+        db.write("tx_relation \"{}\" {} {}\n", tr_1.get_tx_fiber().get_tx_db()->get_relation_name(relation_handle), tr_1.get_id(),
+                 tr_2.get_id());
+    }
+
+    void record_txs(tx_generator_base const& gen, tx_batch const& batch) override {
+        auto lock = lock_writer();
+        for(auto& e : batch.txs) {
+            db.write("tx_begin {} {} {}\n", e.id, gen.get_id(), e.begin_time.to_string());
+            for(auto i = e.first_attribute; i < e.first_attribute + e.attribute_count; ++i)
+                value_visitor<DB>::writeAttribute(db, e.id, batch.attributes[i].name, batch.attributes[i].v);
+            db.write("tx_end {} {} {}\n", e.id, gen.get_id(), e.end_time.to_string());
+            if(e.parent)
+                db.write("tx_relation \"{}\" {} {}\n", gen.get_tx_fiber().get_tx_db()->get_relation_name(batch.parent_relation), e.id,
+                         e.parent->get_id());
+        }
+    }
+
+private:
+    std::unique_lock<std::mutex> lock_writer() {
+        std::unique_lock<std::mutex> lock(writer_mtx, std::defer_lock);
+        if(thread_safe)
+            lock.lock();
+        return lock;
+    }
+};
 // ----------------------------------------------------------------------------
-template <typename DB> void tx_handle_relation_cbf(const tx_handle& tr_1, const tx_handle& tr_2, tx_relation_handle relation_handle) {
-    if(tr_1.get_tx_fiber().get_tx_db() == nullptr)
-        return;
-    if(tr_1.get_tx_fiber().get_tx_db()->get_recording() == false)
-        return;
-    if(!Writer<DB>::get().is_open())
-        return;
-    if(Writer<DB>::get().is_open()) {
-        Writer<DB>::get().write("tx_relation \"{}\" {} {}\n", tr_1.get_tx_fiber().get_tx_db()->get_relation_name(relation_handle),
-                                tr_1.get_id(), tr_2.get_id());
+template <typename DB> std::unique_ptr<tx_backend> create_backend(tx_db const& _tx_db) {
+    auto file_name = (_tx_db.get_name().length() ? _tx_db.get_name() : std::string("tx_default")) + "." + Writer<DB>::get_extension();
+    Writer<DB> db;
+    if(db.open(file_name)) {
+        std::stringstream ss;
+        ss << "opening file " << file_name;
+        SC_REPORT_INFO(__FUNCTION__, ss.str().c_str());
+        return std::unique_ptr<tx_backend>(new tx_text_backend<DB>(file_name, std::move(db)));
     }
+    std::stringstream ss;
+    ss << "Can't open text recording file. " << strerror(errno);
+    SC_REPORT_ERROR(__FUNCTION__, ss.str().c_str());
+    return nullptr;
 }
 // ----------------------------------------------------------------------------
 } // namespace
 // ----------------------------------------------------------------------------
 void tx_text_init() {
-    tx_db::register_class_cb(tx_db_cbf<PlainWriter>);
-    tx_fiber::register_class_cb(tx_fiber_cbf<PlainWriter>);
-    tx_generator_base::register_class_cb(tx_generator_cbf<PlainWriter>);
-    tx_handle::register_class_cb(tx_handle_cbf<PlainWriter>);
-    tx_handle::register_record_attribute_cb(tx_handle_record_attribute_cbf<PlainWriter>);
-    tx_handle::register_relation_cb(tx_handle_relation_cbf<PlainWriter>);
+    tx_db::register_backend(create_backend<PlainWriter>);
 }
 #ifdef WITH_ZLIB
 void tx_text_gz_init() {
-    tx_db::register_class_cb(tx_db_cbf<GZipWriter>);
-    tx_fiber::register_class_cb(tx_fiber_cbf<GZipWriter>);
-    tx_generator_base::register_class_cb(tx_generator_cbf<GZipWriter>);
-    tx_handle::register_class_cb(tx_handle_cbf<GZipWriter>);
-    tx_handle::register_record_attribute_cb(tx_handle_record_attribute_cbf<GZipWriter>);
-    tx_handle::register_relation_cb(tx_handle_relation_cbf<GZipWriter>);
+    tx_db::register_backend(create_backend<GZipWriter>);
 }
 #endif
 #ifdef WITH_LZ4
 void tx_text_lz4_init() {
-    tx_db::register_class_cb(tx_db_cbf<LZ4Writer>);
-    tx_fiber::register_class_cb(tx_fiber_cbf<LZ4Writer>);
-    tx_generator_base::register_class_cb(tx_generator_cbf<LZ4Writer>);
-    tx_handle::register_class_cb(tx_handle_cbf<LZ4Writer>);
-    tx_handle::register_record_attribute_cb(tx_handle_record_attribute_cbf<LZ4Writer>);
-    tx_handle::register_relation_cb(tx_handle_relation_cbf<LZ4Writer>);
+    tx_db::register_backend(create_backend<LZ4Writer>);
 }
 #endif
 } // namespace lwtr
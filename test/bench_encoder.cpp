@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * Copyright 2023 MINRES Technologies GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *******************************************************************************/
+
+// Microbenchmark comparing ftr::encoder against the previous byte-wise CBOR encoder on a tx stream resembling a
+// bus trace: consecutive ids, a handful of generators, picosecond time stamps and address/data/length attributes.
+// The speedup depends on compiler flags and machine: with GCC 12 on a shared Xeon VM (1M tx, best of 10 rounds) it
+// ranged from 2x to 3.2x at -O2 and from 1.3x to 1.8x at -O3, where the legacy encoder benefits most from inlining.
+
+#include <ftr/ftr_writer.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace {
+// the encoder as it was before: one push_back per byte and a compare chain to select the head size
+struct legacy_encoder {
+    std::vector<uint8_t> buffer;
+    void push(uint8_t value) { buffer.push_back(value); }
+    void clear() { buffer.clear(); }
+    template <typename T> typename std::enable_if<std::is_signed<T>::value, void>::type write(T value) {
+        if(value < 0)
+            write_type_value(1, std::abs(value) - 1);
+        else
+            write_type_value(0, value);
+    }
+    template <typename T> typename std::enable_if<std::is_unsigned<T>::value, void>::type write(T value) { write_type_value(0, value); }
+    void write(double value) {
+        auto* punny = reinterpret_cast<uint8_t*>(&value);
+        push(static_cast<uint8_t>((7 << 5) | 27));
+        for(int i = 7; i >= 0; --i)
+            push(*(punny + i));
+    }
+    void start_array(size_t size) { write_type_value(4, size); }
+    void write_tag(const uint64_t tag) { write_type_value(6, tag); }
+
+private:
+    void write_type_value(int major_type, uint64_t value) {
+        major_type <<= 5;
+        if(value < 24) {
+            push(static_cast<uint8_t>(major_type | value));
+        } else if(value < std::numeric_limits<uint8_t>::max()) {
+            push(static_cast<uint8_t>(major_type | 24));
+            push(static_cast<uint8_t>(value));
+        } else if(value < std::numeric_limits<uint16_t>::max()) {
+            push(static_cast<uint8_t>(major_type | 25));
+            push(static_cast<uint8_t>(value >> 8));
+            push(static_cast<uint8_t>(value));
+        } else if(value < std::numeric_limits<uint32_t>::max()) {
+            push(static_cast<uint8_t>(major_type | 26));
+            for(int shift = 24; shift >= 0; shift -= 8)
+                push(static_cast<uint8_t>(value >> shift));
+        } else {
+            push(static_cast<uint8_t>(major_type | 27));
+            for(int shift = 56; shift >= 0; shift -= 8)
+                push(static_cast<uint8_t>(value >> shift));
+        }
+    }
+};
+
+struct tx {
+    uint64_t id, generator, start, end;
+    uint64_t addr, length;
+    int64_t resp;
+    double latency;
+};
+
+std::vector<tx> make_stream(size_t count) {
+    std::mt19937_64 rng(42);
+    std::vector<tx> txs(count);
+    uint64_t time = 0;
+    for(size_t i = 0; i < count; ++i) {
+        time += 1000 * (1 + rng() % 20); // 1ns..20ns apart
+        auto duration = 1000 * (1 + rng() % 100);
+        txs[i] = {i + 1, 1 + rng() % 4, time, time + duration, 0x80000000ULL + (rng() % (1 << 20)) * 4, 1ULL << (rng() % 7),
+                  -static_cast<int64_t>(rng() % 2), duration / 1000.0};
+    }
+    return txs;
+}
+
+template <typename ENC> void encode(ENC& enc, std::vector<tx> const& txs) {
+    for(auto const& t : txs) {
+        enc.start_array(5);
+        enc.write_tag(6);
+        enc.start_array(4);
+        enc.write(t.id);
+        enc.write(t.generator);
+        enc.write(t.start);
+        enc.write(t.end);
+        enc.write_tag(7);
+        enc.start_array(3);
+        enc.write(uint64_t(10));
+        enc.write(uint64_t(3));
+        enc.write(t.addr);
+        enc.write_tag(7);
+        enc.start_array(3);
+        enc.write(uint64_t(11));
+        enc.write(uint64_t(3));
+        enc.write(t.length);
+        enc.write_tag(9);
+        enc.start_array(3);
+        enc.write(uint64_t(12));
+        enc.write(uint64_t(2));
+        enc.write(t.resp);
+        enc.write_tag(9);
+        enc.start_array(3);
+        enc.write(uint64_t(13));
+        enc.write(uint64_t(4));
+        enc.write(t.latency);
+    }
+}
+
+template <typename ENC> double run(std::vector<tx> const& txs, unsigned rounds, size_t& bytes) {
+    ENC enc;
+    auto best = std::numeric_limits<double>::max();
+    for(unsigned r = 0; r < rounds; ++r) {
+        enc.clear();
+        auto start = std::chrono::steady_clock::now();
+        encode(enc, txs);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    bytes = enc.buffer.size();
+    return best / txs.size();
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    auto count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000UL;
+    auto rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10UL;
+    auto txs = make_stream(count);
+    size_t legacy_bytes, bytes;
+    auto legacy_ns = run<legacy_encoder>(txs, rounds, legacy_bytes);
+    auto ns = run<ftr::encoder<ftr::memory_writer>>(txs, rounds, bytes);
+    std::cout << "legacy encoder: " << legacy_ns << " ns/tx, " << legacy_bytes << " bytes\n";
+    std::cout << "ftr::encoder:   " << ns << " ns/tx, " << bytes << " bytes\n";
+    std::cout << "speedup:        " << legacy_ns / ns << "x\n";
+    return 0;
+}
@@ -0,0 +1,607 @@
+/*******************************************************************************
+ * Copyright 2023 MINRES Technologies GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *******************************************************************************/
+
+// Writes FTR files in every block format with and without compression (LZ4, LZ4 with compression dictionaries and
+// zstd if available), reads them back with a minimal CBOR decoder and compares the transactions, attributes and
+// relations. It also checks that the index and the footer point to the actual chunks.
+
+#include <ftr/ftr_writer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+// ----------------------------------------------------------------------------
+// CBOR items as far as FTR uses them
+struct item {
+    enum kind_t { UINT, NINT, BYTES, TEXT, ARRAY, MAP, TAG, REAL, SIMPLE } kind{UINT};
+    uint64_t value{0}; // UINT, NINT (-1 - value), TAG number, SIMPLE value
+    double real{0};
+    std::string data;        // BYTES, TEXT
+    std::vector<item> items; // ARRAY, MAP (keys and values alternating), TAG (the tagged item)
+
+    uint64_t uint() const {
+        if(kind != UINT)
+            throw std::runtime_error("unsigned integer expected");
+        return value;
+    }
+    int64_t sint() const {
+        if(kind != UINT && kind != NINT)
+            throw std::runtime_error("integer expected");
+        return kind == UINT ? static_cast<int64_t>(value) : -1 - static_cast<int64_t>(value);
+    }
+    item const& operator[](size_t i) const {
+        if(i >= items.size())
+            throw std::runtime_error("missing array element");
+        return items[i];
+    }
+};
+
+struct reader {
+    uint8_t const* begin;
+    uint8_t const* p;
+    uint8_t const* end;
+
+    explicit reader(std::string const& data)
+    : begin(reinterpret_cast<uint8_t const*>(data.data()))
+    , p(begin)
+    , end(begin + data.size()) {}
+
+    size_t offset() const { return p - begin; }
+    bool at_break() const { return p < end && *p == 0xff; }
+
+    uint8_t byte() {
+        if(p >= end)
+            throw std::runtime_error("unexpected end of data");
+        return *p++;
+    }
+
+    uint64_t argument(uint8_t info) {
+        if(info < 24)
+            return info;
+        unsigned size = info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : info == 27 ? 8 : 0;
+        if(!size)
+            throw std::runtime_error("invalid head");
+        uint64_t value = 0;
+        for(unsigned i = 0; i < size; ++i)
+            value = value << 8 | byte();
+        return value;
+    }
+
+    item read() {
+        item ret;
+        auto const head = byte();
+        auto const major = head >> 5;
+        auto const info = head & 31;
+        bool const indefinite = info == 31 && major >= 2 && major <= 5;
+        uint64_t const arg = indefinite || major == 7 ? 0 : argument(info);
+        switch(major) {
+        case 0:
+            ret.value = arg;
+            break;
+        case 1:
+            ret.kind = item::NINT;
+            ret.value = arg;
+            break;
+        case 2:
+        case 3:
+            if(indefinite)
+                throw std::runtime_error("indefinite strings are not used by FTR");
+            if(static_cast<uint64_t>(end - p) < arg)
+                throw std::runtime_error("string exceeds data");
+            ret.kind = major == 2 ? item::BYTES : item::TEXT;
+            ret.data.assign(reinterpret_cast<char const*>(p), arg);
+            p += arg;
+            break;
+        case 4:
+        case 5:
+            ret.kind = major == 4 ? item::ARRAY : item::MAP;
+            if(indefinite) {
+                while(!at_break())
+                    ret.items.push_back(read());
+                ++p;
+            } else
+                for(uint64_t i = 0; i < (major == 4 ? arg : 2 * arg); ++i)
+                    ret.items.push_back(read());
+            break;
+        case 6:
+            ret.kind = item::TAG;
+            ret.value = arg;
+            ret.items.push_back(read());
+            break;
+        default:
+            if(info == 26 || info == 27) {
+                auto bits = argument(info);
+                ret.kind = item::REAL;
+                if(info == 26) {
+                    uint32_t b32 = static_cast<uint32_t>(bits);
+                    float f;
+                    std::memcpy(&f, &b32, sizeof(f));
+                    ret.real = f;
+                } else
+                    std::memcpy(&ret.real, &bits, sizeof(ret.real));
+            } else {
+                ret.kind = item::SIMPLE;
+                ret.value = info < 24 ? info : argument(info);
+            }
+        }
+        return ret;
+    }
+};
+
+item parse(std::string const& data) {
+    reader r(data);
+    auto ret = r.read();
+    if(r.p != r.end)
+        throw std::runtime_error("trailing data after item");
+    return ret;
+}
+// ----------------------------------------------------------------------------
+// transactions as written and as read back, attribute values are rendered as strings
+struct attribute {
+    uint64_t event;
+    std::string name;
+    uint64_t type;
+    std::string value;
+    bool operator<(attribute const& o) const {
+        return std::tie(event, name, type, value) < std::tie(o.event, o.name, o.type, o.value);
+    }
+    bool operator==(attribute const& o) const { return !(*this < o) && !(o < *this); }
+};
+
+struct transaction {
+    uint64_t id, generator, stream, start, end;
+    std::vector<attribute> attributes;
+    bool operator<(transaction const& o) const { return id < o.id; }
+};
+
+std::string hex(std::string const& data) {
+    static char const digits[] = "0123456789abcdef";
+    std::string ret;
+    for(unsigned char c : data) {
+        ret += digits[c >> 4];
+        ret += digits[c & 15];
+    }
+    return ret;
+}
+
+std::string number(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.17g", value);
+    return buf;
+}
+
+struct test_failure : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+void check(bool condition, std::string const& what) {
+    if(!condition)
+        throw test_failure(what);
+}
+// ----------------------------------------------------------------------------
+// the data written to each file
+struct recording {
+    std::vector<transaction> txs;
+    std::set<std::vector<uint64_t>> relations; // name is always "parent_of": src stream, src id, sink stream, sink id
+};
+
+enum { STREAMS = 3, TX_COUNT = 6000 };
+
+template <bool COMPRESSED>
+recording write(std::string const& name, ftr::block_policy const& policy, ftr::compression const& comp, unsigned queue_depth) {
+    recording rec;
+    ftr::ftr_writer<COMPRESSED> w(name, 4096, queue_depth, 2, comp, policy);
+    w.writeInfo(-12);
+    for(uint64_t s = 1; s <= STREAMS; ++s) {
+        w.writeStream(s, "stream" + std::to_string(s), "kind");
+        w.writeGenerator(10 * s, "read", s);
+        w.writeGenerator(10 * s + 1, "write", s);
+    }
+    // lwtr passes attribute names as string views
+    nonstd::string_view const name_addr{"addr"}, name_cmd{"cmd"}, name_tag{"tag"}, name_delta{"delta"}, name_ratio{"ratio"}, name_ok{"ok"},
+        name_data{"data"};
+    // writes the end attributes of a transaction begun by beginTransaction() and ends it
+    auto end_tx = [&](ftr::tx_entry* e, transaction const& t) {
+        auto const j = t.id - 1;
+        uint8_t const b[2] = {static_cast<uint8_t>(j), static_cast<uint8_t>(j >> 8 & 0x3)};
+        w.writeAttribute(e, ftr::event_type::END, 0, name_ok, ftr::data_type::BOOLEAN, j % 4 != 0);
+        w.writeAttribute(e, ftr::event_type::END, 1, name_data, ftr::data_type::BIT_VECTOR, ftr::packed_vector{10, b, 2});
+        w.endTransaction(e, t.end);
+    };
+    std::vector<std::pair<ftr::tx_entry*, size_t>> open;
+    for(uint64_t i = 0; i < TX_COUNT; ++i) {
+        auto const stream = 1 + i % STREAMS;
+        transaction tx{i + 1, 10 * stream + i % 2, stream, 1000 * i, 1000 * i + 10 * (i % 7), {}};
+        auto const cmd = std::string(i % 3 ? "RD" : "WR");
+        auto const tag = "tag" + std::to_string(i); // unique values are written inline past max_distinct_strings
+        int64_t const delta = static_cast<int64_t>(i % 5) - 2;
+        double const ratio = i / 7.0;
+        uint8_t const bits[2] = {static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8 & 0x3)};
+        ftr::packed_vector const vec{10, bits, 2};
+        // PLAIN blocks keep writing vectors as strings, the most significant position first
+        std::string vec_value(10, '0');
+        for(unsigned p = 0; p < 10; ++p)
+            vec_value[9 - p] = "01"[bits[p / 8] >> (p % 8) & 1];
+        if(policy.format != ftr::block_format::PLAIN)
+            vec_value = "10:" + hex(std::string(reinterpret_cast<char const*>(bits), 2));
+        tx.attributes = {{7, "addr", 3, std::to_string(0x1000 + 4 * i)}, {7, "cmd", 10, cmd},      {7, "tag", 10, tag},
+                         {8, "delta", 2, std::to_string(delta)},         {8, "ratio", 4, number(ratio)},
+                         {9, "ok", 0, i % 4 ? "true" : "false"},         {9, "data", 5, vec_value}};
+        if(i % 10 == 9) {
+            // complete transactions as recorded by tx_generator::record_txs()
+            w.writeTransaction(tx.id, tx.generator, stream, tx.start, tx.end, 7);
+            w.writeTransactionAttribute(ftr::event_type::BEGIN, 0, name_addr, ftr::data_type::UNSIGNED, 0x1000 + 4 * i);
+            w.writeTransactionAttribute(ftr::event_type::BEGIN, 1, name_cmd, ftr::data_type::STRING, cmd);
+            w.writeTransactionAttribute(ftr::event_type::BEGIN, 2, name_tag, ftr::data_type::STRING, tag);
+            w.writeTransactionAttribute(ftr::event_type::RECORD, 0, name_delta, ftr::data_type::INTEGER, delta);
+            w.writeTransactionAttribute(ftr::event_type::RECORD, 0, name_ratio, ftr::data_type::FLOATING_POINT_NUMBER, ratio);
+            w.writeTransactionAttribute(ftr::event_type::END, 0, name_ok, ftr::data_type::BOOLEAN, i % 4 != 0);
+            w.writeTransactionAttribute(ftr::event_type::END, 1, name_data, ftr::data_type::BIT_VECTOR, vec);
+        } else {
+            auto* e = w.beginTransaction(tx.id, tx.generator, stream, tx.start);
+            w.writeAttribute(e, ftr::event_type::BEGIN, 0, name_addr, ftr::data_type::UNSIGNED, 0x1000 + 4 * i);
+            w.writeAttribute(e, ftr::event_type::BEGIN, 1, name_cmd, ftr::data_type::STRING, cmd);
+            w.writeAttribute(e, ftr::event_type::BEGIN, 2, name_tag, ftr::data_type::STRING, tag.c_str());
+            w.writeAttribute(e, ftr::event_type::RECORD, 0, name_delta, ftr::data_type::INTEGER, delta);
+            w.writeAttribute(e, ftr::event_type::RECORD, 0, name_ratio, ftr::data_type::FLOATING_POINT_NUMBER, ratio);
+            // transactions of a stream overlap so the entries are ended out of order
+            open.emplace_back(e, rec.txs.size());
+            if(open.size() > 4) {
+                auto const& o = open[i % open.size()];
+                end_tx(o.first, o.second < rec.txs.size() ? rec.txs[o.second] : tx);
+                open.erase(open.begin() + i % open.size());
+            }
+        }
+        if(i % 11 == 0 && i) {
+            w.writeRelation(w.getRelationKey("parent_of"), stream, tx.id, 1 + (i - 1) % STREAMS, i);
+            rec.relations.insert({1 + (i - 1) % STREAMS, i, stream, tx.id});
+        }
+        rec.txs.push_back(tx);
+    }
+    for(auto const& o : open)
+        end_tx(o.first, rec.txs[o.second]);
+    w.close();
+    check(!w.error(), "write error");
+    return rec;
+}
+// ----------------------------------------------------------------------------
+std::string decompress(item const& size, item const& data, bool zstd, std::string const* dict) {
+    std::string out(size.uint(), '\0');
+    if(zstd) {
+#ifdef WITH_ZSTD
+        auto ret = ZSTD_decompress(&out[0], out.size(), data.data.data(), data.data.size());
+        check(!ZSTD_isError(ret) && ret == out.size(), "zstd decompression failed");
+        return out;
+#else
+        check(false, "zstd chunk without zstd support");
+#endif
+    }
+    auto ret = dict ? LZ4_decompress_safe_usingDict(data.data.data(), &out[0], static_cast<int>(data.data.size()),
+                                                    static_cast<int>(out.size()), dict->data(), static_cast<int>(dict->size()))
+                    : LZ4_decompress_safe(data.data.data(), &out[0], static_cast<int>(data.data.size()), static_cast<int>(out.size()));
+    check(ret == static_cast<int>(out.size()), "LZ4 decompression failed");
+    return out;
+}
+
+// returns the little endian numbers of a column stored byte plane wise
+std::vector<uint64_t> unshuffle(std::string const& data, size_t width) {
+    check(data.size() % width == 0, "column size");
+    auto const count = data.size() / width;
+    std::vector<uint64_t> ret(count);
+    for(size_t i = 0; i < count; ++i)
+        for(size_t plane = 0; plane < width; ++plane)
+            ret[i] |= static_cast<uint64_t>(static_cast<uint8_t>(data[plane * count + i])) << (8 * plane);
+    return ret;
+}
+
+struct chunk {
+    uint64_t type;
+    bool compressed, zstd;
+    size_t offset;
+};
+
+chunk chunk_of(item const& tag, size_t offset) {
+    check(tag.kind == item::TAG, "chunk tag expected");
+    if(tag.value >= 6 && tag.value <= 15)
+        return {(tag.value - 6) / 2, tag.value % 2 == 1, false, offset};
+    check(tag.value >= ftr::EXT_CHUNK_TAG_BASE && tag.value < ftr::EXT_CHUNK_TAG_BASE + 2 * ftr::ZSTD_TAG_OFFSET, "unknown chunk tag");
+    auto n = tag.value - ftr::EXT_CHUNK_TAG_BASE;
+    bool zstd = n >= ftr::ZSTD_TAG_OFFSET;
+    if(zstd)
+        n -= ftr::ZSTD_TAG_OFFSET;
+    return {n / 2, n % 2 == 1, zstd, offset};
+}
+
+bool is_string(uint64_t type) {
+    return type == static_cast<uint64_t>(ftr::data_type::STRING) || type == static_cast<uint64_t>(ftr::data_type::BIT_VECTOR) ||
+           type == static_cast<uint64_t>(ftr::data_type::LOGIC_VECTOR);
+}
+
+// a value as rendered by write(), string ids are marked by '#' and resolved once all dictionary chunks are read
+std::string render(item const& v, uint64_t type) {
+    switch(v.kind) {
+    case item::UINT:
+        return (is_string(type) ? "#" : "") + std::to_string(v.value);
+    case item::NINT:
+        return std::to_string(v.sint());
+    case item::REAL:
+        return number(v.real);
+    case item::SIMPLE:
+        return v.value == 21 ? "true" : "false";
+    case item::TEXT:
+        return v.data;
+    case item::ARRAY:
+        return std::to_string(v[0].uint()) + ":" + hex(v[1].data);
+    default:
+        throw test_failure("unexpected attribute value");
+    }
+}
+
+struct decoded {
+    std::vector<transaction> txs;
+    std::set<std::vector<uint64_t>> relations;
+    std::set<std::string> chunk_kinds;
+};
+
+decoded read(std::string const& name) {
+    std::ifstream in(name, std::ios::binary);
+    std::string const file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    reader r(file);
+    auto const self = r.read();
+    check(self.kind == item::TAG && self.value == 55799 && !self.items.empty(), "self described CBOR tag");
+    // the tag above consumed the whole array, so the chunks are read again to record their offsets
+    r.p = r.begin + 3;
+    check(r.byte() == 0x9f, "indefinite array of chunks");
+    decoded ret;
+    std::map<uint64_t, std::string> strings{{0, ""}};
+    std::map<uint64_t, std::string> dictionaries;
+    std::map<size_t, chunk> chunks;
+    std::map<size_t, std::vector<uint64_t>> block_headers; // stream, start, end of tx chunks by offset
+    std::vector<std::pair<item, std::vector<uint64_t>>> blocks;
+    item index;
+    size_t index_offset = 0;
+    uint64_t footer = 0;
+    while(!r.at_break()) {
+        auto const offset = r.offset();
+        auto const tag = r.read();
+        auto const c = chunk_of(tag, offset);
+        chunks[offset] = c;
+        auto const& v = tag[0];
+        switch(c.type) {
+        case ftr::INFO_CHUNK_ID:
+            check(parse(v.data)[0].sint() == -12, "timescale");
+            break;
+        case ftr::DICT_CHUNK_ID: {
+            auto const map = parse(c.compressed ? decompress(v[0], v[1], c.zstd, nullptr) : v.data);
+            for(size_t i = 0; i < map.items.size(); i += 2)
+                strings[map.items[i].uint()] = map.items[i + 1].data;
+            break;
+        }
+        case ftr::DIR_CHUNK_ID:
+        case ftr::REL_CHUNK_ID: {
+            auto const content = parse(c.compressed ? decompress(v[0], v[1], c.zstd, nullptr) : v.data);
+            if(c.type == ftr::REL_CHUNK_ID)
+                for(auto const& rel : content.items)
+                    ret.relations.insert({rel[3].uint(), rel[1].uint(), rel[4].uint(), rel[2].uint()});
+            break;
+        }
+        case ftr::COMP_DICT_CHUNK_ID:
+            dictionaries[v[0].uint()] = decompress(v[1], v[2], false, nullptr);
+            ret.chunk_kinds.insert("dictionary");
+            break;
+        case ftr::INDEX_CHUNK_ID:
+            index = parse(v.data);
+            index_offset = offset;
+            break;
+        case ftr::FOOTER_CHUNK_ID:
+            footer = v.uint();
+            break;
+        default: {
+            check(ftr::is_tx_chunk(c.type), "unknown chunk type");
+            bool const dict =
+                c.type == ftr::DICT_TX_CHUNK_ID || c.type == ftr::DICT_DELTA_TX_CHUNK_ID || c.type == ftr::DICT_COLUMNAR_TX_CHUNK_ID;
+            auto const content = dict ? decompress(v[4], v[5], c.zstd, &dictionaries.at(v[3].uint()))
+                                 : c.compressed ? decompress(v[3], v[4], c.zstd, nullptr)
+                                                : v[3].data;
+            bool const delta = c.type == ftr::DELTA_TX_CHUNK_ID || c.type == ftr::DICT_DELTA_TX_CHUNK_ID;
+            bool const columnar = c.type == ftr::COLUMNAR_TX_CHUNK_ID || c.type == ftr::DICT_COLUMNAR_TX_CHUNK_ID;
+            ret.chunk_kinds.insert(columnar ? "columnar" : delta ? "delta" : "plain");
+            block_headers[offset] = {v[0].uint(), v[1].uint(), v[2].uint()};
+            blocks.emplace_back(parse(content), std::vector<uint64_t>{v[0].uint(), v[1].uint(), v[2].uint(), delta, columnar});
+        }
+        }
+    }
+    ++r.p;
+    check(r.p == r.end, "data after the final break");
+    // transactions of all blocks
+    for(auto const& b : blocks) {
+        auto const& content = b.first;
+        auto const stream = b.second[0];
+        std::vector<transaction> txs;
+        if(b.second[4]) {
+            auto const id = unshuffle(content[0].data, 8), gen = unshuffle(content[1].data, 8);
+            auto const start = unshuffle(content[2].data, 8), end = unshuffle(content[3].data, 8);
+            uint64_t prev_id = 0, prev_start = 0;
+            for(size_t i = 0; i < id.size(); ++i) {
+                prev_id += id[i];
+                prev_start += start[i];
+                txs.push_back({prev_id, gen[i], stream, prev_start, prev_start + end[i], {}});
+            }
+            for(auto const& column : content[4].items) {
+                auto const rows = unshuffle(column[3].data, 4);
+                check(rows.size() == column[4].items.size(), "column length");
+                for(size_t i = 0; i < rows.size(); ++i) {
+                    check(rows[i] < txs.size(), "column row");
+                    txs[rows[i]].attributes.push_back(
+                        {column[0].uint(), std::to_string(column[1].uint()), column[2].uint(), render(column[4][i], column[2].uint())});
+                }
+            }
+        } else {
+            int64_t prev[3] = {0, 0, 0};
+            for(auto const& tx : content.items) {
+                auto const& h = tx[0];
+                check(h.kind == item::TAG && h.value == 6, "transaction header");
+                uint64_t f[4];
+                for(unsigned k = 0; k < 4; ++k)
+                    f[k] = b.second[3] ? static_cast<uint64_t>(h[0][k].sint()) : h[0][k].uint();
+                if(b.second[3]) {
+                    for(unsigned k = 0; k < 3; ++k)
+                        prev[k] += f[k];
+                    f[0] = prev[0], f[1] = prev[1], f[2] = prev[2], f[3] += f[2];
+                }
+                txs.push_back({f[0], f[1], stream, f[2], f[3], {}});
+                for(size_t k = 1; k < tx.items.size(); ++k) {
+                    auto const& a = tx[k];
+                    txs.back().attributes.push_back(
+                        {a.value, std::to_string(a[0][0].uint()), a[0][1].uint(), render(a[0][2], a[0][1].uint())});
+                }
+            }
+        }
+        for(auto const& tx : txs)
+            check(b.second[1] <= tx.start && tx.end <= b.second[2], "time range of the tx block");
+        ret.txs.insert(ret.txs.end(), txs.begin(), txs.end());
+    }
+    // resolve attribute names and string ids
+    for(auto& tx : ret.txs)
+        for(auto& a : tx.attributes) {
+            a.name = strings.at(std::stoull(a.name));
+            if(!is_string(a.type))
+                continue;
+            bool const id = a.value.size() && a.value[0] == '#';
+            if(id)
+                a.value = strings.at(std::stoull(a.value.substr(1)));
+            if(a.type == static_cast<uint64_t>(ftr::data_type::STRING))
+                ret.chunk_kinds.insert(id ? "string id" : "inline string");
+            else
+                ret.chunk_kinds.insert(id ? "vector string" : "packed vector");
+        }
+    // the index and the footer
+    check(index_offset && footer == index_offset, "footer points to the index");
+    auto const tail = file.size() - 15;
+    check(static_cast<uint8_t>(file[tail]) == 0xda && static_cast<uint8_t>(file[tail + 5]) == 0x1b, "footer size");
+    size_t listed = 0;
+    for(auto const& e : index[0].items) {
+        auto it = chunks.find(e[1].uint());
+        check(it != chunks.end() && it->second.type == e[0].uint(), "index entry points to its chunk");
+        ++listed;
+    }
+    std::vector<uint64_t> prev;
+    for(auto const& e : index[1].items) {
+        auto it = block_headers.find(e[3].uint());
+        check(it != block_headers.end(), "index entry points to a tx block");
+        check(it->second == std::vector<uint64_t>({e[0].uint(), e[1].uint(), e[2].uint()}), "index entry matches the tx block");
+        std::vector<uint64_t> key{e[0].uint(), e[1].uint()};
+        check(prev.empty() || prev <= key, "tx blocks of the index are sorted");
+        prev = key;
+        ++listed;
+    }
+    check(listed + 2 == chunks.size(), "index lists all chunks");
+    return ret;
+}
+// ----------------------------------------------------------------------------
+template <bool COMPRESSED>
+void run(std::string const& label, ftr::block_format format, ftr::compression comp, unsigned queue_depth, char const* expected_kind,
+         size_t memory_budget = 0) {
+    auto const name = "test_ftr_roundtrip.ftr";
+    ftr::block_policy policy;
+    policy.format = format;
+    policy.block_size = 8192;
+    policy.memory_budget = memory_budget;
+    policy.max_distinct_strings = 64;
+    auto const rec = write<COMPRESSED>(name, policy, comp, queue_depth);
+    auto got = read(name);
+    check(got.chunk_kinds.count(expected_kind), std::string("no ") + expected_kind + " chunks");
+    if(COMPRESSED && comp.dictionary_size)
+        check(got.chunk_kinds.count("dictionary"), "no compression dictionary chunks");
+    check(got.chunk_kinds.count("string id"), "no string ids");
+    // PLAIN blocks keep the value encodings of the original format
+    if(format == ftr::block_format::PLAIN) {
+        check(!got.chunk_kinds.count("inline string"), "inline strings in PLAIN blocks");
+        check(!got.chunk_kinds.count("packed vector"), "packed vectors in PLAIN blocks");
+    } else {
+        check(got.chunk_kinds.count("inline string"), "no inline strings");
+        check(!got.chunk_kinds.count("vector string"), "vectors written as strings");
+    }
+    check(got.txs.size() == rec.txs.size(), "number of transactions");
+    std::sort(got.txs.begin(), got.txs.end());
+    for(size_t i = 0; i < rec.txs.size(); ++i) {
+        auto const& e = rec.txs[i];
+        auto& g = got.txs[i];
+        std::ostringstream where;
+        where << "transaction " << e.id << ": ";
+        check(e.id == g.id && e.generator == g.generator && e.stream == g.stream, where.str() + "header");
+        check(e.start == g.start && e.end == g.end, where.str() + "time stamps");
+        // columnar blocks keep the order within a column only
+        auto expected = e.attributes;
+        std::sort(expected.begin(), expected.end());
+        std::sort(g.attributes.begin(), g.attributes.end());
+        check(expected == g.attributes, where.str() + "attributes");
+    }
+    check(got.relations == rec.relations, "relations");
+    std::remove(name);
+    std::cout << label << ": passed\n";
+}
+} // namespace
+
+int main() {
+    struct format {
+        char const* name;
+        ftr::block_format format;
+        char const* kind;
+    } const formats[] = {{"plain", ftr::block_format::PLAIN, "plain"},
+                         {"delta", ftr::block_format::DELTA, "delta"},
+                         {"columnar", ftr::block_format::COLUMNAR, "columnar"}};
+    int failed = 0;
+    for(auto const& f : formats) {
+        ftr::compression lz4;
+        ftr::compression lz4_dict;
+        lz4_dict.dictionary_size = 4096;
+        ftr::compression lz4_hc;
+        lz4_hc.algorithm = ftr::codec::LZ4_HC;
+        try {
+            run<false>(std::string(f.name) + " uncompressed", f.format, {}, 0, f.kind);
+            run<false>(std::string(f.name) + " uncompressed, writer thread", f.format, {}, 4, f.kind);
+            // blocks are written while complete transactions are appended
+            run<false>(std::string(f.name) + " uncompressed, memory budget", f.format, {}, 0, f.kind, 4096);
+            run<true>(std::string(f.name) + " LZ4", f.format, lz4, 0, f.kind);
+            run<true>(std::string(f.name) + " LZ4, compression threads", f.format, lz4, 4, f.kind);
+            run<true>(std::string(f.name) + " LZ4 with dictionary", f.format, lz4_dict, 0, f.kind);
+            run<true>(std::string(f.name) + " LZ4 with dictionary, compression threads", f.format, lz4_dict, 4, f.kind);
+            run<true>(std::string(f.name) + " LZ4_HC", f.format, lz4_hc, 4, f.kind);
+#ifdef WITH_ZSTD
+            ftr::compression zstd;
+            zstd.algorithm = ftr::codec::ZSTD;
+            run<true>(std::string(f.name) + " zstd", f.format, zstd, 4, f.kind);
+#endif
+        } catch(std::exception const& e) {
+            std::cerr << f.name << ": failed: " << e.what() << "\n";
+            ++failed;
+        }
+    }
+    return failed ? 1 : 0;
+}
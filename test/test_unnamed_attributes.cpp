@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+// begin and end attributes of generators without attribute names are recorded as "unnamed" respectively by the
+// names of their fields, earlier versions of the FTR backend dropped them
+#include <lwtr/lwtr.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct request {
+    unsigned addr;
+    unsigned data;
+};
+
+namespace lwtr {
+template <class Archive> void record(Archive& ar, request const& r) { ar & field("addr", r.addr) & field("data", r.data); }
+} // namespace lwtr
+
+struct recorded {
+    lwtr::event_type event;
+    std::string name;
+};
+
+std::vector<recorded> attributes;
+
+struct probe_backend : lwtr::tx_backend {
+    void create_fiber(lwtr::tx_fiber const&) override {}
+    void create_generator(lwtr::tx_generator_base const&) override {}
+    void begin_tx(lwtr::tx_handle const&) override {}
+    void record_attribute(lwtr::tx_handle const&, lwtr::event_type event, unsigned, nonstd::string_view const& name,
+                          lwtr::value const&) override {
+        attributes.push_back({event, std::string(name.data(), name.size())});
+    }
+    void end_tx(lwtr::tx_handle const&) override {}
+    void add_relation(lwtr::tx_handle const&, lwtr::tx_handle const&, lwtr::tx_relation_handle) override {}
+    void record_txs(lwtr::tx_generator_base const&, lwtr::tx_batch const&) override {}
+};
+
+int main() {
+    const std::string test_file = "test_unnamed_attributes";
+    lwtr::tx_ftr_init(false);
+    lwtr::tx_db::register_backend([](lwtr::tx_db const&) { return std::unique_ptr<lwtr::tx_backend>(new probe_backend); });
+    {
+        lwtr::tx_db db(test_file);
+        lwtr::tx_fiber fiber("fiber", "kind");
+        lwtr::tx_generator<request, int> gen("gen", fiber);
+        gen.begin_tx(request{1, 2}).end_tx(42);
+    }
+    std::vector<recorded> const expected{
+        {lwtr::event_type::BEGIN, "addr"}, {lwtr::event_type::BEGIN, "data"}, {lwtr::event_type::END, "unnamed"}};
+    bool passed = attributes.size() == expected.size();
+    for(size_t i = 0; passed && i < expected.size(); ++i)
+        passed = attributes[i].event == expected[i].event && attributes[i].name == expected[i].name;
+    if(!passed) {
+        std::cerr << "Test failed! Recorded attributes:";
+        for(auto& a : attributes)
+            std::cerr << " '" << a.name << "'";
+        std::cerr << "\n";
+        return 2;
+    }
+    // the names are interned in the uncompressed dictionary chunk of the FTR file
+    std::ifstream in(test_file + ".ftr", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    for(auto& e : expected)
+        if(content.find(e.name) == std::string::npos) {
+            std::cerr << "Test failed! '" << e.name << "' not found in " << test_file << ".ftr\n";
+            return 3;
+        }
+    std::cout << "Test passed!\n";
+    return 0;
+}
+
+// Dummy sc_main for SystemC linkage
+int sc_main(int, char**) { return 0; }